@@ -2,12 +2,7 @@
 #define _DOUBLE_LINKED_LIST_H
 
 #include <stdint.h>  // For standard integer types (size_t)
-#include <stdio.h>   // For potential use with displayList (optional)
-
-#define NULL_PTR 0                 // Define NULL pointer macro
-#define EQUIV_REQ 1                // Define constant for comparison result (equal)
-#define LARGER_THAN_REQ 2          // Define constant for comparison result (larger)
-#define SMALLER_THAN_REQ 3         // Define constant for comparison result (smaller)
+#include <stdio.h>   // For the users printing their lists
 
 // Define size_t type if not already defined elsewhere
 typedef unsigned long size_t;
@@ -25,106 +20,126 @@ typedef enum {
   NOK,                       // Operation failed (generic error)
   NULLPTR,                    // Null pointer encountered
 } return_status_t;
+
 /**
- * @brief Inserts a node into the doubly linked list at a specified index.
- *
- * This function takes pointers to the head of the list (`ptrHead`), a pointer to the
- * node to be inserted (`ptrNode`), and the index at which to insert (`nodeIndex`). It
- * updates the pointers of surrounding nodes to maintain the list structure after insertion.
+ * @brief Intrusive doubly linked list of node_t
  *
- * @param ptrNode Pointer to the node to be inserted into the list.
- * @param nodeIndex Index at which to insert the node (0-based).
- * @param ptrHead Pointer to the head node of the doubly linked list (may be updated).
- *
- * @return return_status_t indicating success (OK), error (NOK, out-of-range index),
- *         or NULL pointer error (NULLPTR).
+ * The nodes live inside the objects they link (chunks, spans, blocks), the list only keeps its
+ * ends and its length, so every operation below is O(1) and never walks the list.
+ * An all-zero list_t is a valid empty list. A node is on at most one list at a time.
  */
-return_status_t addNode(node_t **ptrNode,size_t nodeIndex,node_t **ptrHead);
+typedef struct list {
+  node_t *head;            // First node, NULL when the list is empty
+  node_t *tail;            // Last node, NULL when the list is empty
+  size_t count;            // Number of nodes in the list
+} list_t;
 
 /**
- * @brief Appends a node to the end of the doubly linked list.
- *
- * This function takes a pointer to the head of the list (`ptrHead`) and a pointer to the node to be appended (`ptrNode`).
- * It updates the pointers of the last node and the new node to link them in the list.
+ * @brief Inserts a node after a node of the list.
  *
- * @param ptrHead Pointer to the head node of the doubly linked list.
- * @param ptrNode Pointer to the node to be appended to the list.
- * 
- * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ * @param list List holding 'pos'.
+ * @param pos Node of the list, or NULL to insert at the head.
+ * @param node Node to insert, not on any list.
  */
-return_status_t appendNode(node_t *ptrHead,node_t *ptrNode);
+static inline void listInsertAfter(list_t *list, node_t *pos, node_t *node) {
+    node->prev = pos;
+    node->next = (NULL != pos) ? pos->next : list->head;
+    if (NULL != node->next) {
+        node->next->prev = node;
+    } else {
+        list->tail = node;
+    }
+    if (NULL != pos) {
+        pos->next = node;
+    } else {
+        list->head = node;
+    }
+    list->count++;
+}
+
 /**
- * @brief Merges two adjacent nodes in the doubly linked list.
- *
- * This function takes pointers to the first node (`ptrFristNode`) and the second node (`ptrSecNode`) to be merged.
- * It assumes the nodes are adjacent in the list.
- * The function combines the sizes of the nodes and updates the pointers of surrounding nodes to reflect the merge.
+ * @brief Inserts a node before a node of the list.
  *
- * @param ptrFristNode Pointer to the first node to be merged.
- * @param ptrSecNode Pointer to the second node to be merged.
- * 
- * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ * @param list List holding 'pos'.
+ * @param pos Node of the list, or NULL to insert at the tail.
+ * @param node Node to insert, not on any list.
  */
-return_status_t mergeTwoNodes(node_t *ptrFristNode,node_t *ptrSecNode);
+static inline void listInsertBefore(list_t *list, node_t *pos, node_t *node) {
+    listInsertAfter(list, (NULL != pos) ? pos->prev : list->tail, node);
+}
+
 /**
- * @brief (Optional) Prints the contents of the doubly linked list to standard output.
- *
- * This function takes the pointer to the head node (`ptrHead`) of the list.
- * It iterates through the list and prints the size of each node.
+ * @brief Inserts a node at the head of the list.
  *
- * Note: This function might be used for debugging purposes and may not be necessary for core functionality.
- *
- * @param ptrHead Pointer to the head node of the doubly linked list.
- * 
- * @return return_status_t indicating success (OK) or error (NOK) or (NULLPTR).
+ * @param list List to insert in.
+ * @param node Node to insert, not on any list.
  */
-return_status_t displayList(node_t *ptrHead);
+static inline void listPushFront(list_t *list, node_t *node) {
+    listInsertAfter(list, NULL, node);
+}
+
 /**
- * @brief Removes a node from the doubly linked list at a specified index.
- *
- * This function takes pointers to the head of the list (`ptrHead`), a pointer to store the removed node (`ptrNode`), 
- * and the index of the node to be removed (`index`).
- * It updates the pointers of surrounding nodes to maintain the list structure after removal.
+ * @brief Appends a node at the tail of the list.
  *
- * @param ptrHead Pointer to the head node of the doubly linked list (may be updated).
- * @param ptrNode Output pointer to receive the removed node.
- * @param index Index of the node to be removed (0-based).
- * 
- * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ * @param list List to append to.
+ * @param node Node to append, not on any list.
  */
-return_status_t removeNode(node_t **ptrHead, node_t **ptrNode);
+static inline void listPushBack(list_t *list, node_t *node) {
+    listInsertAfter(list, list->tail, node);
+}
+
 /**
- * @brief Removes the first node (head) from the doubly linked list.
+ * @brief Removes a node from the list.
  *
- * This function takes a pointer to the head of the list (`ptrHead`).
- * It updates the head pointer to point to the next node and adjusts pointers of surrounding nodes if necessary.
+ * The links of the removed node are left as they were.
  *
- * @param ptrHead Pointer to the head node of the doubly linked list (may be updated).
- * 
- * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ * @param list List holding the node.
+ * @param node Node to remove.
  */
-return_status_t removeBeginning(node_t **ptrHead);
+static inline void listRemove(list_t *list, node_t *node) {
+    if (NULL != node->prev) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+    if (NULL != node->next) {
+        node->next->prev = node->prev;
+    } else {
+        list->tail = node->prev;
+    }
+    list->count--;
+}
+
 /**
- * @brief Removes the last node from the doubly linked list.
+ * @brief Removes the first node of the list.
  *
- * This function takes a pointer to the head of the list (`ptrHead`).
- * It iterates through the list to find the last node and updates pointers to remove it from the list.
+ * @param list List to pop from.
  *
- * @param ptrHead Pointer to the head node of the doubly linked list
- * 
- * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ * @return The removed node, or NULL when the list is empty.
  */
-return_status_t removeEnd(node_t **ptrNode);
+static inline node_t *listPopFront(list_t *list) {
+    node_t *node = list->head;
+
+    if (NULL != node) {
+        listRemove(list, node);
+    }
+    return node;
+}
+
 /**
- * @brief Calculates the length (number of nodes) of the doubly linked list.
+ * @brief Removes the last node of the list.
  *
- * This function takes the pointer to the head node (`ptrHead`) of the list.
- * It iterates through the list and increments a counter for each node encountered.
+ * @param list List to pop from.
  *
- * @param ptrHead Pointer to the head node of the doubly linked list.
- * 
- * @return uint32_t The number of nodes in the list.
+ * @return The removed node, or NULL when the list is empty.
  */
-size_t getLength(node_t *ptrHead);
-return_status_t addInHead(node_t *ptrNode,size_t nodeIndex,node_t **copyHeadFreeListNode);
-#endif
\ No newline at end of file
+static inline node_t *listPopBack(list_t *list) {
+    node_t *node = list->tail;
+
+    if (NULL != node) {
+        listRemove(list, node);
+    }
+    return node;
+}
+
+#endif // _DOUBLE_LINKED_LIST_H
@@ -0,0 +1,232 @@
+/*
+ * File: arena.c
+ * Description: multiple arenas, each with its own lock, free list, slabs and memory source.
+ * Author: Mohamed Eslam
+ */
+
+#define _GNU_SOURCE // For sched_getaffinity and CPU_COUNT
+#include <sched.h>
+#include <sys/mman.h> // For mmap and madvise
+#include "hmm.h"
+
+static uint32_t arenaCount(void);
+
+arena_t arenaTable[ARENA_MAX_NUM]; // Zero-initialized, so every arena starts empty and unlocked
+static uint8_t *mainHeapStart = NULL; // First address ever returned by sbrk
+static uint32_t arenaNum = 0; // Number of arenas threads are spread on, computed on first use
+static uint32_t arenaNext = 0; // Round-robin counter for the thread assignment
+static __thread arena_t *threadArena __attribute__((tls_model("initial-exec"))); // Arena of the calling thread
+
+
+/**
+ * @brief Returns the arena of the calling thread
+ *
+ * Threads are assigned round-robin to ARENA_PER_CPU arenas per CPU on their first allocation,
+ * the first thread (usually the main one) getting the main arena.
+ *
+ * @return Pointer to the arena of the calling thread
+ */
+arena_t *arenaGet(void) {
+    arena_t *arena = threadArena;
+
+    if (NULL == arena) {
+        uint32_t index = __atomic_fetch_add(&arenaNext, 1, __ATOMIC_RELAXED);
+        arena = &arenaTable[index % arenaCount()];
+        threadArena = arena;
+    }
+    return arena;
+}
+
+/**
+ * @brief Finds the arena owning a heap chunk
+ *
+ * Chunks below the program break belong to the main arena, any other chunk lives in a region
+ * whose header holds its arena.
+ *
+ * @param chunk Pointer to the chunk metadata of a chunk carved from an arena heap
+ *
+ * @return Pointer to the owning arena
+ */
+arena_t *arenaOf(node_t *chunk) {
+    arena_t *arena = NULL;
+    uint8_t *mainBreak = (uint8_t *)__atomic_load_n(&arenaTable[0].programBreak, __ATOMIC_RELAXED);
+
+    if (((uint8_t *)chunk >= mainHeapStart) && ((uint8_t *)chunk < mainBreak)) {
+        arena = &arenaTable[0];
+    } else {
+        region_t *region = (region_t *)((uintptr_t)chunk & ~((uintptr_t)ARENA_REGION_SIZE - 1));
+        arena = region->arena;
+    }
+    return arena;
+}
+
+/**
+ * @brief Moves the end of an arena heap, the arena counterpart of sbrk
+ *
+ * The main arena calls sbrk. The other arenas move their break inside the current region,
+ * mapping a new region when it is exhausted; the pages released by a negative increment
+ * are given back with madvise. A request that can never fit in a region fails, the caller
+ * then falls back to the main arena. Successful calls are counted in the arena statistics.
+ * In THP mode (HMM_THP) the heaps start on a huge page boundary and are advised with
+ * MADV_HUGEPAGE: the program break is first padded up to ARENA_HUGE_PAGE_SIZE, the heap of a
+ * region starts at its second huge page. The heap engines then grow and shrink them by whole
+ * huge pages, so the kernel can back them with huge pages and never has to split one.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to grow or shrink
+ * @param increment Number of bytes to add (or remove when negative)
+ *
+ * @return The previous end of the heap (the start of the new memory), or NULL on failure
+ */
+void *arenaMoreCore(arena_t *arena, intptr_t increment) {
+    uint8_t *oldBreak = (uint8_t *)arena->programBreak;
+    uint8_t hugePages = (uint8_t)TUNE_GET(hugePages);
+    size_t regionHeader = hugePages ? ARENA_HUGE_PAGE_SIZE : ARENA_REGION_HEADER; // Heap offset in a new region
+
+    if (arena == &arenaTable[0]) {
+        size_t pad = 0; // Bytes skipped so the new memory starts on a huge page, a new heap segment then
+
+        if (hugePages && (increment > 0)) {
+            uintptr_t curBreak = (uintptr_t)sbrk(0);
+            pad = ((curBreak + ARENA_HUGE_PAGE_SIZE - 1) & ~((uintptr_t)ARENA_HUGE_PAGE_SIZE - 1)) - curBreak;
+        }
+        oldBreak = sbrk(increment + pad);
+        if ((void *)-1 == oldBreak) {
+            oldBreak = NULL;
+        } else {
+            oldBreak += pad;
+            if (NULL == mainHeapStart) {
+                mainHeapStart = oldBreak;
+            }
+            if (hugePages && (increment > 0)) {
+                madvise(oldBreak, increment, MADV_HUGEPAGE);
+            }
+            __atomic_store_n(&arena->programBreak, (uint32_t *)(oldBreak + increment), __ATOMIC_RELAXED);
+        }
+    } else if (increment < 0) {
+        uint8_t *newBreak = oldBreak + increment;
+        uint8_t *pageStart = (uint8_t *)(((uintptr_t)newBreak + getpagesize() - 1) & ~((uintptr_t)getpagesize() - 1));
+        if (pageStart < oldBreak) {
+            madvise(pageStart, oldBreak - pageStart, MADV_DONTNEED);
+        }
+        arena->programBreak = (uint32_t *)newBreak;
+    } else if ((NULL != oldBreak) && (increment <= arena->regionEnd - oldBreak)) {
+        arena->programBreak = (uint32_t *)(oldBreak + increment);
+    } else if (increment <= (intptr_t)(ARENA_REGION_SIZE - regionHeader)) {
+        region_t *region = arenaMapRegion(arena);
+        oldBreak = NULL;
+        if (NULL != region) {
+            oldBreak = (uint8_t *)region + regionHeader;
+            arena->regionEnd = (uint8_t *)region + ARENA_REGION_SIZE;
+            arena->programBreak = (uint32_t *)(oldBreak + increment);
+        }
+    } else {
+        oldBreak = NULL; // Too large for any region
+    }
+
+    if (NULL != oldBreak) {
+        arena->heapBytes += increment;
+        if (increment < 0) {
+            arena->trimNum++;
+        } else {
+            arena->growNum++;
+        }
+    }
+    return oldBreak;
+}
+
+/**
+ * @brief Maps a new region for an arena
+ *
+ * Twice the size is mapped and trimmed to the ARENA_REGION_SIZE alignment, so arenaOf finds
+ * the region header of any chunk by aligning its address down. The pages are only reserved
+ * (MAP_NORESERVE), they are committed as they are touched. In THP mode every huge page of the
+ * region but the first one, which holds the header, is advised with MADV_HUGEPAGE.
+ *
+ * @param arena Arena owning the new region
+ *
+ * @return Pointer to the region header, or NULL if mmap failed
+ */
+region_t *arenaMapRegion(arena_t *arena) {
+    region_t *region = NULL;
+    uint8_t *map = mmap(NULL, 2 * (size_t)ARENA_REGION_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (MAP_FAILED != map) {
+        uint8_t *aligned = (uint8_t *)(((uintptr_t)map + ARENA_REGION_SIZE - 1) & ~((uintptr_t)ARENA_REGION_SIZE - 1));
+        if (aligned != map) {
+            munmap(map, aligned - map);
+        }
+        munmap(aligned + ARENA_REGION_SIZE, (map + 2 * (size_t)ARENA_REGION_SIZE) - (aligned + ARENA_REGION_SIZE));
+
+        if (TUNE_GET(hugePages)) {
+            madvise(aligned + ARENA_HUGE_PAGE_SIZE, ARENA_REGION_SIZE - ARENA_HUGE_PAGE_SIZE, MADV_HUGEPAGE);
+        }
+        region = (region_t *)aligned;
+        region->arena = arena;
+        region->size = ARENA_REGION_SIZE;
+    }
+    return region;
+}
+
+/**
+ * @brief Makes the next thread assignment compute the number of arenas again
+ *
+ * Called when the arena maximum changes, the threads already assigned keep their arena.
+ */
+void arenaResetCount(void) {
+    __atomic_store_n(&arenaNum, 0, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Takes every arena lock right before fork()
+ */
+void arenaForkPrepare(void) {
+    for (uint32_t i = 0; i < ARENA_MAX_NUM; i++) {
+        pthread_mutex_lock(&arenaTable[i].lock);
+    }
+}
+
+/**
+ * @brief Releases every arena lock in the parent after fork()
+ */
+void arenaForkParent(void) {
+    for (uint32_t i = 0; i < ARENA_MAX_NUM; i++) {
+        pthread_mutex_unlock(&arenaTable[i].lock);
+    }
+}
+
+/**
+ * @brief Resets every arena lock in the child after fork(), only the forking thread survives
+ */
+void arenaForkChild(void) {
+    for (uint32_t i = 0; i < ARENA_MAX_NUM; i++) {
+        pthread_mutex_init(&arenaTable[i].lock, NULL);
+    }
+}
+
+/**
+ * @brief Computes the number of arenas once
+ *
+ * sched_getaffinity is used rather than sysconf, it is a plain system call that never allocates.
+ *
+ * @return ARENA_PER_CPU arenas per usable CPU, at most the arena maximum (HMM_ARENA_MAX)
+ */
+static uint32_t arenaCount(void) {
+    uint32_t num = __atomic_load_n(&arenaNum, __ATOMIC_RELAXED);
+
+    if (0 == num) {
+        cpu_set_t cpuSet;
+        uint32_t cpuNum = 1;
+        if (0 == sched_getaffinity(0, sizeof(cpuSet), &cpuSet)) {
+            cpuNum = CPU_COUNT(&cpuSet);
+        }
+        num = cpuNum * ARENA_PER_CPU;
+        if ((0 == num) || (num > TUNE_GET(arenaMax))) {
+            num = TUNE_GET(arenaMax);
+        }
+        __atomic_store_n(&arenaNum, num, __ATOMIC_RELAXED);
+    }
+    return num;
+}
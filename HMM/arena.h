@@ -0,0 +1,112 @@
+#ifndef ARENA_H  // Include guard to prevent multiple inclusions
+#define ARENA_H
+
+#include <pthread.h>  // For the lock of every arena
+#include "slab.h"  // Every arena owns its own slab spans
+#include "freeindex.h"  // Index of the free heap chunks, chosen by the engine
+#include "decay.h"  // Decay state of the dirty pages of every arena
+
+#define ARENA_MAX_NUM 256 // Maximum number of arenas
+#define ARENA_PER_CPU 4 // Default number of arenas per CPU the process may run on
+#define ARENA_REGION_SIZE (64*1024*1024) // Size (and alignment) of the mmap'ed regions of the non-main arenas
+#define ARENA_REGION_HEADER 16 // Bytes reserved at the beginning of a region for region_t
+#define ARENA_HUGE_PAGE_SIZE (2*1024*1024) // Transparent huge page, alignment of the heaps in THP mode (HMM_THP)
+#define ARENA_PURGE_UNIT() (TUNE_GET(hugePages) ? (size_t)ARENA_HUGE_PAGE_SIZE : (size_t)getpagesize()) // Granularity of the heap growths, shrinks and purges
+
+/**
+ * @brief Heap state owned by one arena
+ *
+ * Arena 0 (the main arena) grows the program break with sbrk. The other arenas carve their heap
+ * from ARENA_REGION_SIZE aligned mmap'ed regions, so the owner of any chunk is found either by
+ * checking the program break range or by aligning its address down to the region header.
+ * An all-zero arena is a valid empty arena with an unlocked mutex.
+ */
+typedef struct arena {
+  pthread_mutex_t lock;                        // Protects everything below
+  free_index_t freeIndex;                      // Free heap chunks, indexed by the engine
+  uint32_t *programBreak;                      // End of the heap (the program break of the main arena)
+  uint8_t *regionEnd;                          // End of the current region (non-main arenas only)
+  uint8_t *zeroStart;                          // Heap memory from here to the fence is known to be zero (heap.c)
+  list_t dirtyList;                            // Free chunks whose pages may be resident, oldest first (heap.c)
+  size_t dirtyBytes;                           // Whole pages of the chunks on the dirty list
+  decay_t decay;                               // Bytes dirtied in the last epochs, for the purge of the dirty list
+  list_t slabPartialList[SLAB_CLASS_NUM];      // Spans having at least one free object, per class
+  // Statistics, read by hmm_stats under the lock
+  size_t inUseBytes;                           // Bytes of the allocated heap chunks
+  size_t heapBytes;                            // Bytes of heap obtained from the OS
+  size_t growNum;                              // Heap growths (sbrk calls, region break moves, new regions)
+  size_t trimNum;                              // Heap memory given back to the OS
+  size_t slabSpanNum;                          // Slab spans mapped
+  size_t slabUsedNum[SLAB_CLASS_NUM];          // Slab objects out of their spans (thread caches included), per class
+} arena_t;
+
+/**
+ * @brief Header stored at the beginning of every region of a non-main arena
+ */
+typedef struct region {
+  arena_t *arena;          // Arena owning the region
+  size_t size;             // Mapped size of the region
+} region_t;
+
+extern arena_t arenaTable[ARENA_MAX_NUM]; // All the arenas, arenaTable[0] is the main arena
+
+/**
+ * @brief Returns the arena of the calling thread
+ *
+ * Threads are assigned round-robin to ARENA_PER_CPU arenas per CPU on their first allocation.
+ *
+ * @return Pointer to the arena of the calling thread
+ */
+arena_t *arenaGet(void);
+
+/**
+ * @brief Finds the arena owning a heap chunk
+ *
+ * @param chunk Pointer to the chunk metadata of a chunk carved from an arena heap
+ *
+ * @return Pointer to the owning arena
+ */
+arena_t *arenaOf(node_t *chunk);
+
+/**
+ * @brief Moves the end of an arena heap, the arena counterpart of sbrk
+ *
+ * The main arena calls sbrk. The other arenas move their break inside the current region,
+ * mapping a new region when it is exhausted; the pages released by a negative increment
+ * are given back with madvise.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to grow or shrink
+ * @param increment Number of bytes to add (or remove when negative)
+ *
+ * @return The previous end of the heap (the start of the new memory), or NULL on failure
+ */
+void *arenaMoreCore(arena_t *arena, intptr_t increment);
+
+/**
+ * @brief Maps a new ARENA_REGION_SIZE aligned region for an arena
+ *
+ * @param arena Arena owning the new region
+ *
+ * @return Pointer to the region header, or NULL if mmap failed
+ */
+region_t *arenaMapRegion(arena_t *arena);
+
+/**
+ * @brief Makes the next thread assignment compute the number of arenas again
+ *
+ * Called when the arena maximum changes, the threads already assigned keep their arena.
+ *
+ * @return Nothing
+ */
+void arenaResetCount(void);
+
+/**
+ * @brief pthread_atfork handlers keeping the arena locks consistent across fork()
+ */
+void arenaForkPrepare(void);
+void arenaForkParent(void);
+void arenaForkChild(void);
+
+#endif  // ARENA_H
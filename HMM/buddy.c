@@ -0,0 +1,438 @@
+/*
+ * File: buddy.c
+ * Description: buddy engine, a binary buddy system replacing the boundary-tag heap of the arenas.
+ * Author: Mohamed Eslam
+ */
+
+#include <sys/mman.h> // For madvise and munmap
+#include "hmm.h"
+
+#if ((1 << (BUDDY_MAX_ORDER + 1)) != ARENA_REGION_SIZE)
+#error "A region must hold exactly two blocks of BUDDY_MAX_ORDER"
+#endif
+
+#if (BUDDY_MAX_ORDER > BUDDY_MAP_ORDER_MASK) || (BUDDY_RESERVED_SIZE < ARENA_REGION_HEADER)
+#error "The order map must hold every order and the region header"
+#endif
+
+#define BUDDY_NODE(block) ((node_t *)(block)) // List links of a free block
+
+static uint32_t orderOf(size_t blockSize);
+static uint8_t *takeBlock(arena_t *arena, uint32_t order, uint8_t *ptrZeroFlag);
+static void pushBlock(free_index_t *index, uint8_t *block, uint32_t order, uint8_t zeroFlag);
+static void unlinkBlock(free_index_t *index, uint8_t *block, uint32_t order);
+static return_status_t addRegion(arena_t *arena);
+
+
+/**
+ * @brief Allocates a chunk from the buddy blocks of an arena
+ *
+ * The chunk takes a whole block of the smallest order large enough (takeBlock) and its user area
+ * is the block. With 'zeroed', only the first page (huge page in THP mode) of a block flagged
+ * BUDDY_MAP_ZERO is cleared.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param zeroed Non-zero when the user area must read as zero (calloc)
+ *
+ * @return A pointer to the user area of the chunk, or NULL if the chunk does not fit in a block
+ *         or no region could be mapped
+ */
+void *heapAlloc(arena_t *arena, size_t size, uint8_t zeroed) {
+    uint32_t order = orderOf(BUDDY_CHUNK_BLOCK(size));
+    uint8_t zeroFlag = 0;
+    uint8_t *block = takeBlock(arena, order, &zeroFlag);
+
+    if ((NULL != block) && zeroed) {
+        size_t usable = (size_t)1 << order;
+
+        if ((0 != zeroFlag) && (usable > ARENA_PURGE_UNIT())) {
+            usable = ARENA_PURGE_UNIT(); // The rest of the block is zero
+        }
+        memset(block, 0, usable);
+    }
+    return block;
+}
+
+/**
+ * @brief Allocates several chunks of the same size from the buddy blocks of an arena
+ *
+ * Blocks cannot be carved from one run, each chunk takes its own block. The first takeBlock
+ * splits a large block down to the order, the halves it leaves on the lists are then taken in
+ * O(1) by the next ones, so the burst only saves the locking of the caller.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of every chunk in bytes (metadata included, multiple of 16)
+ * @param num Number of chunks wanted
+ * @param ptrs Receives the pointers to the user areas of the chunks
+ *
+ * @return Number of chunks allocated, less than 'num' only when no region could be mapped
+ */
+size_t heapAllocBatch(arena_t *arena, size_t size, size_t num, void **ptrs) {
+    size_t allocNum = 0;
+
+    while (allocNum < num) {
+        void *ptr = heapAlloc(arena, size, 0);
+        if (NULL == ptr) {
+            break;
+        }
+        ptrs[allocNum++] = ptr;
+    }
+    return allocNum;
+}
+
+/**
+ * @brief Allocates a chunk whose user area is aligned from the buddy blocks of an arena
+ *
+ * A block is aligned on its size and is its own user area, so any block of at least 'alignment'
+ * bytes is aligned enough: the chunk is a plain one of that many bytes at least.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param alignment Alignment of the user area, a power of two larger than 16
+ *
+ * @return A pointer to the user area of the chunk, or NULL if the chunk does not fit in a block
+ *         or no region could be mapped
+ */
+void *heapAllocAligned(arena_t *arena, size_t size, size_t alignment) {
+    size_t blockSize = BUDDY_CHUNK_BLOCK(size);
+    uint8_t zeroFlag = 0;
+
+    return takeBlock(arena, orderOf((blockSize < alignment) ? alignment : blockSize), &zeroFlag);
+}
+
+/**
+ * @brief Returns a chunk to the buddy blocks of an arena
+ *
+ * While the buddy of the block (its offset in the region with bit 'order' flipped) is a free
+ * block of the same order, both merge into a block of the next order; the reserved head of the
+ * region never merges. The merged block goes to the list of its order; from BUDDY_PURGE_ORDER
+ * on, its pages but the first (huge page in THP mode) are given back to the OS, so they read as
+ * zero again (BUDDY_MAP_ZERO).
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the chunk
+ * @param ptrFreeNode User area of the chunk minus METADATA_SIZE, nothing is read there
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t heapFree(arena_t *arena, node_t *ptrFreeNode) {
+    return_status_t ret = OK;
+
+    if (NULL == ptrFreeNode) {
+        ret = NULLPTR;
+    } else {
+        uint8_t *block = BUDDY_BLOCK_OF(ptrFreeNode);
+        uint8_t *region = BUDDY_REGION_OF(block);
+        uint32_t order = BUDDY_MAP(block) & BUDDY_MAP_ORDER_MASK;
+
+        while (order < BUDDY_MAX_ORDER) {
+            size_t buddyOffset = (size_t)(block - region) ^ ((size_t)1 << order);
+            uint8_t *buddy = region + buddyOffset;
+            if ((buddyOffset < BUDDY_RESERVED_SIZE) || ((BUDDY_MAP(buddy) & ~BUDDY_MAP_ZERO) != (BUDDY_MAP_FREE | order))) {
+                break; // Reserved, in use or split
+            }
+            unlinkBlock(&arena->freeIndex, buddy, order);
+            if (buddy < block) {
+                block = buddy;
+            }
+            order++;
+        }
+        if ((order >= BUDDY_PURGE_ORDER) && (((size_t)1 << order) > ARENA_PURGE_UNIT())) {
+            madvise(block + ARENA_PURGE_UNIT(), ((size_t)1 << order) - ARENA_PURGE_UNIT(), MADV_DONTNEED);
+            arena->trimNum++;
+            pushBlock(&arena->freeIndex, block, order, BUDDY_MAP_ZERO);
+        } else {
+            pushBlock(&arena->freeIndex, block, order, 0);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns several chunks to the buddy blocks of an arena
+ *
+ * Every block is merged with its free buddies by heapFree, in the order of the caller. Unlike the
+ * boundary-tag heap, the chunks are not sorted: in address order every pair freed together merges
+ * up to a large block, which the next burst of allocations has to split again.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning every chunk
+ * @param chunks User areas of the chunks minus METADATA_SIZE, in any order
+ * @param num Number of chunks
+ *
+ * @return return_status_t indicating success (OK) or error (NOK) when a chunk could not be freed.
+ */
+return_status_t heapFreeBatch(arena_t *arena, node_t **chunks, size_t num) {
+    return_status_t ret = OK;
+
+    for (size_t i = 0; i < num; i++) {
+        if (OK != heapFree(arena, chunks[i])) {
+            ret = NOK;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Resizes an allocated chunk without moving its block
+ *
+ * A shrink halves the block down to the needed order, every upper half being freed.
+ * A growth doubles the block while it is the lower half of its buddy pair and the upper half
+ * is free at the same order; it fails without touching anything when this cannot reach the
+ * needed order.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk User area of an allocated chunk minus METADATA_SIZE
+ * @param size New size of the chunk in bytes (metadata included, multiple of 16)
+ *
+ * @return return_status_t indicating success (OK) or error (NOK) when the chunk cannot grow in place.
+ */
+return_status_t heapResize(arena_t *arena, node_t *chunk, size_t size) {
+    return_status_t ret = OK;
+    uint8_t *block = BUDDY_BLOCK_OF(chunk);
+    uint8_t *region = BUDDY_REGION_OF(block);
+    uint32_t order = BUDDY_MAP(block) & BUDDY_MAP_ORDER_MASK;
+    uint32_t newOrder = orderOf(BUDDY_CHUNK_BLOCK(size));
+
+    if (newOrder > BUDDY_MAX_ORDER) {
+        ret = NOK;
+    } else if (newOrder <= order) {
+        while (order > newOrder) {
+            order--;
+            pushBlock(&arena->freeIndex, block + ((size_t)1 << order), order, 0); // Its buddy is in use
+        }
+    } else {
+        // Check first that every upper buddy up to the needed order is free
+        for (uint32_t k = order; (OK == ret) && (k < newOrder); k++) {
+            if ((0 != ((size_t)(block - region) & ((size_t)1 << k))) ||
+                ((BUDDY_MAP(block + ((size_t)1 << k)) & ~BUDDY_MAP_ZERO) != (BUDDY_MAP_FREE | k))) {
+                ret = NOK;
+            }
+        }
+        for (; (OK == ret) && (order < newOrder); order++) {
+            unlinkBlock(&arena->freeIndex, block + ((size_t)1 << order), order);
+        }
+    }
+    if (OK == ret) {
+        BUDDY_MAP(block) = (uint8_t)order;
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns the size of the largest free block, for the statistics
+ *
+ * The highest bit of the order bitmap gives it directly.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to inspect
+ *
+ * @return Size of the largest free chunk in bytes, 0 if no block is free
+ */
+size_t heapLargestFree(arena_t *arena) {
+    size_t size = 0;
+
+    if (0 != arena->freeIndex.orderBitmap) {
+        uint32_t order = BUDDY_MIN_ORDER + 31 - __builtin_clz(arena->freeIndex.orderBitmap);
+        size = (size_t)1 << order;
+    }
+    return size;
+}
+
+/**
+ * @brief Gives the free memory of an arena back to the OS, for malloc_trim
+ *
+ * Regions stay mapped, the pages but the first of every free block not flagged BUDDY_MAP_ZERO
+ * are given back and the block is flagged. In THP mode the first huge page is kept and only
+ * blocks larger than a huge page are trimmed. 'pad' is ignored, a buddy heap has no top to keep.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to trim
+ * @param pad Unused
+ *
+ * @return Number of bytes given back to the OS
+ */
+size_t heapTrim(arena_t *arena, size_t pad) {
+    size_t released = 0;
+    size_t pageSize = ARENA_PURGE_UNIT();
+
+    (void)pad;
+    for (uint32_t order = BUDDY_MIN_ORDER; order <= BUDDY_MAX_ORDER; order++) {
+        if (((size_t)1 << order) <= pageSize) {
+            continue; // Nothing past the first page
+        }
+        for (node_t *node = arena->freeIndex.list[order - BUDDY_MIN_ORDER].head; NULL != node; node = node->next) {
+            uint8_t *block = (uint8_t *)node;
+
+            if ((0 == (BUDDY_MAP(block) & BUDDY_MAP_ZERO)) &&
+                (0 == madvise(block + pageSize, ((size_t)1 << order) - pageSize, MADV_DONTNEED))) {
+                BUDDY_MAP(block) |= BUDDY_MAP_ZERO;
+                released += ((size_t)1 << order) - pageSize;
+                arena->trimNum++;
+            }
+        }
+    }
+    return released;
+}
+
+/**
+ * @brief Decay step of an arena, nothing to do for the buddy engine
+ *
+ * Free blocks are never on a dirty list: a merge reaching BUDDY_PURGE_ORDER purges its block at
+ * once and smaller blocks are only purged by malloc_trim.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Unused
+ * @param now Unused
+ *
+ * @return Nothing
+ */
+void heapDecay(arena_t *arena, uint64_t now) {
+    (void)arena;
+    (void)now;
+}
+
+/**
+ * @brief Returns the smallest order whose blocks hold a number of bytes
+ *
+ * @param blockSize Number of bytes the block must hold
+ *
+ * @return The order, BUDDY_MAX_ORDER + 1 when no block is large enough
+ */
+static uint32_t orderOf(size_t blockSize) {
+    uint32_t order = BUDDY_MIN_ORDER;
+
+    while ((order <= BUDDY_MAX_ORDER) && (((size_t)1 << order) < blockSize)) {
+        order++;
+    }
+    return order;
+}
+
+/**
+ * @brief Takes a block of an order out of the free blocks of an arena
+ *
+ * The smallest non-empty order large enough is found with the order bitmap, its first block
+ * is split in halves down to the needed order, every upper half going to the list of its order.
+ * A new arena region is mapped when no block is large enough.
+ * The halves inherit BUDDY_MAP_ZERO: the bytes past the first page of either half are past the
+ * first page of the split block.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param order Order of the block
+ * @param ptrZeroFlag Receives the BUDDY_MAP_ZERO flag of the block
+ *
+ * @return The block, mapped as in use, or NULL if the order is too large or no region could be mapped
+ */
+static uint8_t *takeBlock(arena_t *arena, uint32_t order, uint8_t *ptrZeroFlag) {
+    uint8_t *block = NULL;
+    free_index_t *index = &arena->freeIndex;
+
+    if (order <= BUDDY_MAX_ORDER) {
+        uint32_t orderMap = index->orderBitmap & (~(uint32_t)0 << (order - BUDDY_MIN_ORDER));
+
+        if ((0 == orderMap) && (OK == addRegion(arena))) {
+            orderMap = index->orderBitmap & (~(uint32_t)0 << (order - BUDDY_MIN_ORDER));
+        }
+        if (0 != orderMap) {
+            uint32_t blockOrder = BUDDY_MIN_ORDER + __builtin_ctz(orderMap);
+
+            block = (uint8_t *)index->list[blockOrder - BUDDY_MIN_ORDER].head;
+            *ptrZeroFlag = BUDDY_MAP(block) & BUDDY_MAP_ZERO;
+            unlinkBlock(index, block, blockOrder);
+            while (blockOrder > order) {
+                // Split: the upper half becomes a free block of the order below
+                blockOrder--;
+                pushBlock(index, block + ((size_t)1 << blockOrder), blockOrder, *ptrZeroFlag);
+            }
+            BUDDY_MAP(block) = (uint8_t)order;
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief Maps a block as free and pushes it on the list of its order
+ *
+ * @param index Free blocks of the arena
+ * @param block Start of the block
+ * @param order Order of the block
+ * @param zeroFlag BUDDY_MAP_ZERO when the bytes past the first page of the block are zero, else 0
+ */
+static void pushBlock(free_index_t *index, uint8_t *block, uint32_t order, uint8_t zeroFlag) {
+    BUDDY_MAP(block) = (uint8_t)(BUDDY_MAP_FREE | zeroFlag | order);
+    BUDDY_NODE(block)->size = (size_t)1 << order;
+    listPushFront(&index->list[order - BUDDY_MIN_ORDER], BUDDY_NODE(block));
+    index->orderBitmap |= (uint32_t)1 << (order - BUDDY_MIN_ORDER);
+    index->freeNum++;
+    index->freeBytes += (size_t)1 << order;
+}
+
+/**
+ * @brief Removes a free block from the list of its order
+ *
+ * @param index Free blocks of the arena
+ * @param block Start of the block
+ * @param order Order of the block
+ */
+static void unlinkBlock(free_index_t *index, uint8_t *block, uint32_t order) {
+    list_t *list = &index->list[order - BUDDY_MIN_ORDER];
+
+    listRemove(list, BUDDY_NODE(block));
+    if (0 == list->count) {
+        index->orderBitmap &= ~((uint32_t)1 << (order - BUDDY_MIN_ORDER));
+    }
+    index->freeNum--;
+    index->freeBytes -= (size_t)1 << order;
+}
+
+/**
+ * @brief Maps a new region and adds its blocks to the arena
+ *
+ * The first BUDDY_RESERVED_SIZE bytes of the region hold its order map, whose first entries
+ * (those of the reserved slots, never read) are overlaid by the region header; no block ever
+ * merges with them. The rest of the region is covered by one free block of every order from
+ * there, each starting at an offset equal to its size, all of them zero but their list links.
+ * The region is recorded in the page map, a region that cannot be is unmapped again.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the new region
+ *
+ * @return return_status_t indicating success (OK) or error (NOK) if the region could not be mapped.
+ */
+static return_status_t addRegion(arena_t *arena) {
+    return_status_t ret = NOK;
+    region_t *region = arenaMapRegion(arena);
+
+    if (NULL == region) {
+        /* Out of address space */
+    } else if (!pageMapSetRegion(region, ARENA_REGION_SIZE)) {
+        munmap(region, ARENA_REGION_SIZE);
+    } else {
+        arena->heapBytes += ARENA_REGION_SIZE;
+        arena->growNum++;
+        for (uint32_t order = BUDDY_MIN_ORDER; order <= BUDDY_MAX_ORDER; order++) {
+            if (((size_t)1 << order) >= BUDDY_RESERVED_SIZE) {
+                pushBlock(&arena->freeIndex, (uint8_t *)region + ((size_t)1 << order), order, BUDDY_MAP_ZERO);
+            }
+        }
+        ret = OK;
+    }
+    return ret;
+}
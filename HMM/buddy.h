@@ -0,0 +1,40 @@
+#ifndef BUDDY_H  // Include guard to prevent multiple inclusions
+#define BUDDY_H
+
+#include "./../DoubleLinkedList/DoubleLinkedList.h"  // node_t links the free blocks of an order
+
+#define BUDDY_MIN_ORDER 10 // Smallest block (1 KiB), heap chunks are larger than SLAB_MAX_SIZE
+#define BUDDY_MAX_ORDER 25 // Largest block (32 MiB), half of an arena region
+#define BUDDY_ORDER_NUM (BUDDY_MAX_ORDER - BUDDY_MIN_ORDER + 1) // Number of orders
+#define BUDDY_PURGE_ORDER 22 // Free blocks of 4 MiB and more give their pages back to the OS
+#define BUDDY_RESERVED_SIZE (ARENA_REGION_SIZE >> BUDDY_MIN_ORDER) // Head of a region holding the order map, one byte per BUDDY_MIN_ORDER block
+#define BUDDY_MAP_ORDER_MASK 0x1F // Low bits of an order map entry holding the order of the block
+#define BUDDY_MAP_FREE 0x20 // Set in the order map entry of a free block
+#define BUDDY_MAP_ZERO 0x40 // Set in the order map entry of a free block whose bytes past its first page (huge page in THP mode) are zero
+#define BUDDY_MAP_SAMPLED 0x80 // Set in the order map entry of an allocated block the profiler sampled
+#define BUDDY_REGION_OF(block) ((uint8_t *)((uintptr_t)(block) & ~((uintptr_t)ARENA_REGION_SIZE - 1))) // Region holding a block
+#define BUDDY_MAP(block) (BUDDY_REGION_OF(block)[((uintptr_t)(block) & ((uintptr_t)ARENA_REGION_SIZE - 1)) >> BUDDY_MIN_ORDER]) // Order map entry of a block
+#define BUDDY_BLOCK_OF(chunk) ((uint8_t *)(chunk) + METADATA_SIZE) // Block of an allocated chunk, the block is its user area
+#define BUDDY_CHUNK_BYTES(chunk) ((size_t)1 << (BUDDY_MAP(BUDDY_BLOCK_OF(chunk)) & BUDDY_MAP_ORDER_MASK)) // Block size of an allocated chunk
+#define BUDDY_CHUNK_BLOCK(size) ((size) - 2 * METADATA_SIZE) // Bytes the block of a chunk size must hold, see REQUEST_TO_CHUNK
+
+/**
+ * @brief Free blocks of the buddy engine
+ *
+ * A block of order k is 2^k bytes, aligned on 2^k within its arena region, so its buddy is found
+ * by flipping bit k of its offset. Blocks carry no metadata: the user area is the whole block, so
+ * a request of 2^k bytes takes a block of order k. The order and the state of every block are
+ * kept in the order map at the head of its region instead, one byte per BUDDY_MIN_ORDER slot
+ * indexed by the offset of the block, and the region is recorded in the page map so free
+ * knows a buddy chunk has no metadata in front of it. Free blocks are kept in one doubly linked
+ * list per order (through a node_t at their start) and one bit per order tells which lists are
+ * not empty.
+ */
+typedef struct free_index {
+  uint32_t orderBitmap;                       // Bit (k - BUDDY_MIN_ORDER) set when list[] of order k is not empty
+  list_t list[BUDDY_ORDER_NUM];               // Free chunks of every order
+  size_t freeNum;                             // Number of free blocks
+  size_t freeBytes;                           // Total size of the free blocks
+} free_index_t;
+
+#endif  // BUDDY_H
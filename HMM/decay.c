@@ -0,0 +1,161 @@
+/*
+ * File: decay.c
+ * Description: time decay of the dirty heap pages, the curve giving how many may stay resident and
+ *              the optional background thread purging them.
+ * Author: Mohamed Eslam
+ */
+
+#include <signal.h> // For the signal mask of the background thread
+#include "hmm.h"
+
+static void *decayThreadMain(void *arg);
+static void decayForkChild(void);
+
+uint8_t decayThreadRunning = 0; // Set by decayThreadStart, cleared when the thread exits or after fork
+
+
+/**
+ * @brief Registers the fork handler of the background thread, called once from the library constructor
+ *
+ * The thread does not exist in a child, it is started again there by its first heap free.
+ *
+ * @return Nothing
+ */
+void decayInit(void) {
+    pthread_atfork(NULL, NULL, decayForkChild);
+}
+
+/**
+ * @brief Reads the monotonic clock
+ *
+ * @return Nanoseconds
+ */
+uint64_t decayNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/**
+ * @brief Moves the epochs of a decay state to the current time
+ *
+ * The backlog is shifted by the number of epochs that passed, the bytes older than the decay
+ * time drop out. The limit is the sum of the backlog weighted by 1 - smoothstep(age), computed
+ * in fixed point: (N^3 - i^2 (3N - 2i)) / N^3 for an age of i epochs out of N. With a decay time
+ * of 0 every call is a step and the limit is 0, everything is purged.
+ *
+ * @param decay Decay state of an arena, under its lock
+ * @param now Current time from decayNow
+ * @param ptrLimit Receives the dirty bytes allowed by the decay curve
+ *
+ * @return 1 when at least one epoch passed (the limit is valid), 0 otherwise
+ */
+uint8_t decayAdvance(decay_t *decay, uint64_t now, size_t *ptrLimit) {
+    uint8_t ret = 0;
+    uint64_t decayMs = TUNE_GET(dirtyDecayMs);
+    uint64_t epochNs = decayMs * 1000000u / DECAY_EPOCH_NUM;
+
+    if (0 == decayMs) {
+        memset(decay->backlog, 0, sizeof(decay->backlog));
+        *ptrLimit = 0;
+        ret = 1;
+    } else if (0 == decay->epochStart) {
+        decay->epochStart = now; // First step, nothing passed yet
+    } else if (now - decay->epochStart >= epochNs) {
+        uint64_t passed = (now - decay->epochStart) / epochNs;
+        const uint64_t cube = (uint64_t)DECAY_EPOCH_NUM * DECAY_EPOCH_NUM * DECAY_EPOCH_NUM;
+        size_t limit = 0;
+
+        if (passed >= DECAY_EPOCH_NUM) {
+            memset(decay->backlog, 0, sizeof(decay->backlog));
+            decay->epochStart = now;
+        } else {
+            memmove(&decay->backlog[passed], &decay->backlog[0], (DECAY_EPOCH_NUM - passed) * sizeof(size_t));
+            memset(decay->backlog, 0, passed * sizeof(size_t));
+            decay->epochStart += passed * epochNs;
+        }
+        for (uint64_t i = 0; i < DECAY_EPOCH_NUM; i++) {
+            uint64_t weight = cube - i * i * (3 * DECAY_EPOCH_NUM - 2 * i);
+            limit += (size_t)(((unsigned __int128)decay->backlog[i] * weight) / cube);
+        }
+        *ptrLimit = limit;
+        ret = 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Starts the background purging thread, unless it already runs
+ *
+ * The thread is detached. When it cannot be created the background purging is turned off and
+ * the amortized tick of the heap frees takes over.
+ *
+ * @note No arena lock may be held, pthread_create allocates
+ *
+ * @return Nothing
+ */
+void decayThreadStart(void) {
+    uint8_t expected = 0;
+
+    if (__atomic_compare_exchange_n(&decayThreadRunning, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        int err = pthread_attr_init(&attr);
+
+        if (0 == err) {
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+            err = pthread_create(&thread, &attr, decayThreadMain, NULL);
+            pthread_attr_destroy(&attr);
+        }
+        if (0 != err) {
+            __atomic_store_n(&hmmTunables.backgroundThread, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&decayThreadRunning, 0, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/**
+ * @brief Body of the background thread, steps the decay of every arena once per epoch
+ *
+ * It never allocates and blocks every signal, so it is invisible to the application.
+ * It exits when the background purging is turned off.
+ *
+ * @param arg Unused
+ *
+ * @return NULL
+ */
+static void *decayThreadMain(void *arg) {
+    sigset_t mask;
+
+    (void)arg;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    while (TUNE_GET(backgroundThread)) {
+        uint64_t decayMs = TUNE_GET(dirtyDecayMs);
+        uint64_t sleepNs = (0 == decayMs) ? (uint64_t)DECAY_IDLE_MS * 1000000u : decayMs * 1000000u / DECAY_EPOCH_NUM;
+        struct timespec ts;
+
+        if (sleepNs < DECAY_MIN_EPOCH_NS) {
+            sleepNs = DECAY_MIN_EPOCH_NS;
+        }
+        ts.tv_sec = sleepNs / 1000000000u;
+        ts.tv_nsec = sleepNs % 1000000000u;
+        nanosleep(&ts, NULL);
+        uint64_t now = decayNow();
+        for (uint32_t i = 0; i < ARENA_MAX_NUM; i++) {
+            pthread_mutex_lock(&arenaTable[i].lock);
+            heapDecay(&arenaTable[i], now);
+            pthread_mutex_unlock(&arenaTable[i].lock);
+        }
+    }
+    __atomic_store_n(&decayThreadRunning, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * @brief Forgets the background thread in a child, which only has the forking thread
+ */
+static void decayForkChild(void) {
+    decayThreadRunning = 0;
+}
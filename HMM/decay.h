@@ -0,0 +1,69 @@
+#ifndef DECAY_H  // Include guard to prevent multiple inclusions
+#define DECAY_H
+
+#include <stdint.h>  // For the clock and the flags
+#include <stddef.h>  // For size_t
+
+#define DECAY_EPOCH_NUM 32 // Epochs of the decay window, the backlog keeps the dirtied bytes of each
+#define DECAY_TICK_NUM 64 // Heap frees of an arena between two decay steps when no background thread runs
+#define DECAY_MS_DEFAULT 10000 // Default decay time of the dirty pages (HMM_DIRTY_DECAY_MS, M_HMM_DIRTY_DECAY_MS)
+#define DECAY_MS_MAX (3600*1000) // Longest decay time, an hour
+#define DECAY_IDLE_MS 1000 // Sleep of the background thread while the decay is off
+#define DECAY_MIN_EPOCH_NS 1000000 // Shortest epoch, so a short decay time does not spin the background thread
+
+// Starts the background thread once it is wanted, a single predicted branch otherwise
+#define DECAY_THREAD_CHECK() \
+    do { if (__builtin_expect(TUNE_GET(backgroundThread) && !__atomic_load_n(&decayThreadRunning, __ATOMIC_RELAXED), 0)) { decayThreadStart(); } } while (0)
+
+/**
+ * @brief Decay state of the dirty pages of one arena
+ *
+ * Time is cut in epochs of decay time / DECAY_EPOCH_NUM. backlog[0] counts the bytes dirtied in
+ * the current epoch, backlog[i] those dirtied i epochs ago. A byte dirtied i epochs ago may stay
+ * dirty with the weight 1 - smoothstep(i / DECAY_EPOCH_NUM), like the dirty_decay_ms of jemalloc:
+ * a burst of frees is purged little at first, then faster, and entirely after the decay time.
+ * An all-zero decay_t is valid.
+ */
+typedef struct decay {
+  uint64_t epochStart;                 // Start of the current epoch (monotonic ns), 0 before the first step
+  size_t backlog[DECAY_EPOCH_NUM];     // Bytes dirtied per epoch, newest first
+  uint32_t tick;                       // Heap frees since the last step
+} decay_t;
+
+extern uint8_t decayThreadRunning; // Set while the background purging thread runs
+
+/**
+ * @brief Registers the fork handler of the background thread, called once from the library constructor
+ *
+ * @return Nothing
+ */
+void decayInit(void);
+
+/**
+ * @brief Reads the monotonic clock
+ *
+ * @return Nanoseconds
+ */
+uint64_t decayNow(void);
+
+/**
+ * @brief Moves the epochs of a decay state to the current time
+ *
+ * @param decay Decay state of an arena, under its lock
+ * @param now Current time from decayNow
+ * @param ptrLimit Receives the dirty bytes allowed by the decay curve
+ *
+ * @return 1 when at least one epoch passed (the limit is valid), 0 otherwise
+ */
+uint8_t decayAdvance(decay_t *decay, uint64_t now, size_t *ptrLimit);
+
+/**
+ * @brief Starts the background purging thread, unless it already runs
+ *
+ * @note No arena lock may be held, pthread_create allocates
+ *
+ * @return Nothing
+ */
+void decayThreadStart(void);
+
+#endif  // DECAY_H
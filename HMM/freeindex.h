@@ -0,0 +1,73 @@
+#ifndef FREEINDEX_H  // Include guard to prevent multiple inclusions
+#define FREEINDEX_H
+
+#include "./../DoubleLinkedList/DoubleLinkedList.h"  // node_t is the chunk metadata
+
+/*
+ * Index of the free heap chunks, the pluggable part of the boundary-tag heap (heap.c).
+ * The heap itself (splitting, coalescing, growth) is shared, the engine only decides how
+ * the free chunks are found. It is selected at build time: make ENGINE=bestfit (default) or
+ * make ENGINE=tlsf. Every engine header defines free_index_t, valid when zero-initialized,
+ * and FREE_INDEX_MIN_CHUNK, the smallest chunk able to hold its links and a footer.
+ * The buddy engine (make ENGINE=buddy) replaces the whole heap, its free_index_t holds its
+ * per-order free lists and it does not implement the functions below.
+ */
+#if defined(HMM_ENGINE_TLSF)
+#include "tlsf.h"  // Two-level segregated fit: O(1) good fit
+#elif defined(HMM_ENGINE_BUDDY)
+#include "buddy.h"  // Binary buddy system: power-of-two blocks
+#else
+#include "freetree.h"  // Red-black tree: O(log n) best fit
+#endif
+
+/**
+ * @brief Inserts a free chunk in the index
+ *
+ * @param index Index of the arena
+ * @param chunk Pointer to the chunk metadata, its size must not change while it is indexed
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t freeIndexInsert(free_index_t *index, node_t *chunk);
+
+/**
+ * @brief Removes a free chunk from the index
+ *
+ * @param index Index of the arena
+ * @param chunk Pointer to the chunk metadata of an indexed chunk
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t freeIndexRemove(free_index_t *index, node_t *chunk);
+
+/**
+ * @brief Finds a free chunk of at least 'size' bytes
+ *
+ * @param index Index of the arena
+ * @param size Requested chunk size
+ *
+ * @return A free chunk large enough, which stays in the index, or NULL if there is none
+ */
+node_t *freeIndexFind(free_index_t *index, size_t size);
+
+/**
+ * @brief Returns the size of the largest free chunk, for the statistics
+ *
+ * @param index Index of the arena
+ *
+ * @return Size of the largest indexed chunk in bytes, 0 if there is none
+ */
+size_t freeIndexLargest(free_index_t *index);
+
+/**
+ * @brief Calls a function on every indexed chunk, for malloc_trim
+ *
+ * @param index Index of the arena
+ * @param visit Function called with every chunk, it must not change the index
+ * @param arg Passed to 'visit'
+ *
+ * @return Nothing
+ */
+void freeIndexWalk(free_index_t *index, void (*visit)(node_t *chunk, void *arg), void *arg);
+
+#endif  // FREEINDEX_H
@@ -0,0 +1,358 @@
+/*
+ * File: freetree.c
+ * Description: best-fit engine, a red-black tree indexing the free heap chunks by size for O(log n) lookups.
+ * Author: Mohamed Eslam
+ */
+
+#include "hmm.h"
+
+#define TREE_RED 0x1 // Color bit of parentColor
+#define TREE_PARENT(node) ((free_tree_node_t *)((node)->parentColor & ~(uintptr_t)TREE_RED)) // Parent node
+#define TREE_IS_RED(node) ((NULL != (node)) && ((node)->parentColor & TREE_RED)) // NULL leaves are black
+#define TREE_SET_RED(node) ((node)->parentColor |= TREE_RED)
+#define TREE_SET_BLACK(node) ((node)->parentColor &= ~(uintptr_t)TREE_RED)
+#define TREE_KEY_LESS(a, b) ((CHUNK_SIZE(a) < CHUNK_SIZE(b)) || ((CHUNK_SIZE(a) == CHUNK_SIZE(b)) && ((a) < (b))))
+
+static void setParent(free_tree_node_t *node, free_tree_node_t *parent);
+static void replaceChild(free_tree_node_t **ptrRoot, free_tree_node_t *parent, free_tree_node_t *oldChild, free_tree_node_t *newChild);
+static void rotateLeft(free_tree_node_t **ptrRoot, free_tree_node_t *node);
+static void rotateRight(free_tree_node_t **ptrRoot, free_tree_node_t *node);
+static void insertFixup(free_tree_node_t **ptrRoot, free_tree_node_t *node);
+static void removeFixup(free_tree_node_t **ptrRoot, free_tree_node_t *node, free_tree_node_t *parent);
+static void walkNode(free_tree_node_t *node, void (*visit)(node_t *chunk, void *arg), void *arg);
+
+
+/**
+ * @brief Inserts a free chunk in the tree, in O(log n)
+ *
+ * @param index Index of the arena
+ * @param chunk Pointer to the chunk metadata, its size must not change while it is in the tree
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t freeIndexInsert(free_index_t *index, node_t *chunk) {
+    return_status_t ret = OK;
+    free_tree_node_t *node = (free_tree_node_t *)chunk;
+
+    if ((NULL == index) || (NULL == chunk)) {
+        ret = NULLPTR;
+    } else {
+        free_tree_node_t **ptrRoot = &index->root;
+        free_tree_node_t *parent = NULL;
+        free_tree_node_t **link = ptrRoot;
+
+        while (NULL != *link) {
+            parent = *link;
+            link = TREE_KEY_LESS(node, parent) ? &parent->left : &parent->right;
+        }
+        node->left = NULL;
+        node->right = NULL;
+        node->parentColor = (uintptr_t)parent | TREE_RED;
+        *link = node;
+        insertFixup(ptrRoot, node);
+        index->freeNum++;
+        index->freeBytes += CHUNK_SIZE(chunk);
+    }
+    return ret;
+}
+
+/**
+ * @brief Removes a free chunk from the tree, in O(log n)
+ *
+ * When the chunk has two children, its successor takes its place (and color) in the tree.
+ *
+ * @param index Index of the arena
+ * @param chunk Pointer to the chunk metadata of a chunk in the tree
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t freeIndexRemove(free_index_t *index, node_t *chunk) {
+    return_status_t ret = OK;
+    free_tree_node_t *node = (free_tree_node_t *)chunk;
+
+    if ((NULL == index) || (NULL == chunk)) {
+        ret = NULLPTR;
+    } else {
+        free_tree_node_t **ptrRoot = &index->root;
+        free_tree_node_t *child = NULL; // Node moving up into the removed position
+        free_tree_node_t *parent = NULL; // Its parent
+        uintptr_t removedRed = 0; // Color of the node actually unlinked from its position
+
+        if ((NULL == node->left) || (NULL == node->right)) {
+            child = (NULL == node->left) ? node->right : node->left;
+            parent = TREE_PARENT(node);
+            removedRed = node->parentColor & TREE_RED;
+            replaceChild(ptrRoot, parent, node, child);
+            if (NULL != child) {
+                setParent(child, parent);
+            }
+        } else {
+            free_tree_node_t *successor = node->right;
+
+            while (NULL != successor->left) {
+                successor = successor->left;
+            }
+            child = successor->right;
+            removedRed = successor->parentColor & TREE_RED;
+            if (TREE_PARENT(successor) == node) {
+                parent = successor;
+            } else {
+                parent = TREE_PARENT(successor);
+                parent->left = child;
+                if (NULL != child) {
+                    setParent(child, parent);
+                }
+                successor->right = node->right;
+                setParent(successor->right, successor);
+            }
+            replaceChild(ptrRoot, TREE_PARENT(node), node, successor);
+            successor->parentColor = node->parentColor; // Same parent and color as the removed node
+            successor->left = node->left;
+            setParent(successor->left, successor);
+        }
+        if (!removedRed) {
+            removeFixup(ptrRoot, child, parent);
+        }
+        index->freeNum--;
+        index->freeBytes -= CHUNK_SIZE(chunk);
+    }
+    return ret;
+}
+
+/**
+ * @brief Finds the best fit for a size, in O(log n)
+ *
+ * Walks down the tree remembering the last node large enough, going left on it since a smaller
+ * (or a lower, equally sized) fit may still exist there.
+ *
+ * @param index Index of the arena
+ * @param size Requested chunk size
+ *
+ * @return The smallest chunk of at least 'size' bytes, the lowest one among equal sizes,
+ *         or NULL if no chunk is large enough. The chunk stays in the tree.
+ */
+node_t *freeIndexFind(free_index_t *index, size_t size) {
+    free_tree_node_t *root = index->root;
+    free_tree_node_t *best = NULL;
+
+    while (NULL != root) {
+        if (CHUNK_SIZE(root) >= size) {
+            best = root;
+            root = root->left;
+        } else {
+            root = root->right;
+        }
+    }
+    return (node_t *)best;
+}
+
+/**
+ * @brief Returns the size of the largest free chunk, the rightmost node, in O(log n)
+ *
+ * @param index Index of the arena
+ *
+ * @return Size of the largest chunk in the tree in bytes, 0 if the tree is empty
+ */
+size_t freeIndexLargest(free_index_t *index) {
+    free_tree_node_t *node = index->root;
+    size_t size = 0;
+
+    if (NULL != node) {
+        while (NULL != node->right) {
+            node = node->right;
+        }
+        size = CHUNK_SIZE(node);
+    }
+    return size;
+}
+
+/**
+ * @brief Calls a function on every chunk of the tree
+ *
+ * The recursion depth is the tree height, at most twice the log2 of the number of chunks.
+ *
+ * @param index Index of the arena
+ * @param visit Function called with every chunk, it must not change the index
+ * @param arg Passed to 'visit'
+ *
+ * @return Nothing
+ */
+void freeIndexWalk(free_index_t *index, void (*visit)(node_t *chunk, void *arg), void *arg) {
+    walkNode(index->root, visit, arg);
+}
+
+/**
+ * @brief Visits a subtree for freeIndexWalk
+ */
+static void walkNode(free_tree_node_t *node, void (*visit)(node_t *chunk, void *arg), void *arg) {
+    if (NULL != node) {
+        walkNode(node->left, visit, arg);
+        visit((node_t *)node, arg);
+        walkNode(node->right, visit, arg);
+    }
+}
+
+/**
+ * @brief Sets the parent of a node, keeping its color
+ */
+static void setParent(free_tree_node_t *node, free_tree_node_t *parent) {
+    node->parentColor = (uintptr_t)parent | (node->parentColor & TREE_RED);
+}
+
+/**
+ * @brief Makes 'newChild' take the place of 'oldChild' under 'parent' (or at the root)
+ */
+static void replaceChild(free_tree_node_t **ptrRoot, free_tree_node_t *parent, free_tree_node_t *oldChild, free_tree_node_t *newChild) {
+    if (NULL == parent) {
+        *ptrRoot = newChild;
+    } else if (parent->left == oldChild) {
+        parent->left = newChild;
+    } else {
+        parent->right = newChild;
+    }
+}
+
+/**
+ * @brief Rotates a node down to the left, its right child takes its place
+ */
+static void rotateLeft(free_tree_node_t **ptrRoot, free_tree_node_t *node) {
+    free_tree_node_t *pivot = node->right;
+
+    node->right = pivot->left;
+    if (NULL != pivot->left) {
+        setParent(pivot->left, node);
+    }
+    setParent(pivot, TREE_PARENT(node));
+    replaceChild(ptrRoot, TREE_PARENT(node), node, pivot);
+    pivot->left = node;
+    setParent(node, pivot);
+}
+
+/**
+ * @brief Rotates a node down to the right, its left child takes its place
+ */
+static void rotateRight(free_tree_node_t **ptrRoot, free_tree_node_t *node) {
+    free_tree_node_t *pivot = node->left;
+
+    node->left = pivot->right;
+    if (NULL != pivot->right) {
+        setParent(pivot->right, node);
+    }
+    setParent(pivot, TREE_PARENT(node));
+    replaceChild(ptrRoot, TREE_PARENT(node), node, pivot);
+    pivot->right = node;
+    setParent(node, pivot);
+}
+
+/**
+ * @brief Restores the red-black properties after inserting a red node
+ */
+static void insertFixup(free_tree_node_t **ptrRoot, free_tree_node_t *node) {
+    free_tree_node_t *parent = NULL;
+
+    while (TREE_IS_RED(parent = TREE_PARENT(node))) {
+        free_tree_node_t *grandParent = TREE_PARENT(parent); // Exists, the root is black
+
+        if (parent == grandParent->left) {
+            free_tree_node_t *uncle = grandParent->right;
+            if (TREE_IS_RED(uncle)) {
+                TREE_SET_BLACK(parent);
+                TREE_SET_BLACK(uncle);
+                TREE_SET_RED(grandParent);
+                node = grandParent;
+            } else {
+                if (node == parent->right) {
+                    rotateLeft(ptrRoot, parent);
+                    node = parent; // The former parent is now the child of node
+                    parent = TREE_PARENT(node);
+                }
+                TREE_SET_BLACK(parent);
+                TREE_SET_RED(grandParent);
+                rotateRight(ptrRoot, grandParent);
+            }
+        } else {
+            free_tree_node_t *uncle = grandParent->left;
+            if (TREE_IS_RED(uncle)) {
+                TREE_SET_BLACK(parent);
+                TREE_SET_BLACK(uncle);
+                TREE_SET_RED(grandParent);
+                node = grandParent;
+            } else {
+                if (node == parent->left) {
+                    rotateRight(ptrRoot, parent);
+                    node = parent; // The former parent is now the child of node
+                    parent = TREE_PARENT(node);
+                }
+                TREE_SET_BLACK(parent);
+                TREE_SET_RED(grandParent);
+                rotateLeft(ptrRoot, grandParent);
+            }
+        }
+    }
+    TREE_SET_BLACK(*ptrRoot);
+}
+
+/**
+ * @brief Restores the red-black properties after unlinking a black node
+ *
+ * 'node' (possibly a NULL leaf, hence the explicit 'parent') carries an extra black that is
+ * moved up the tree until it can be absorbed by a red node or a rotation.
+ */
+static void removeFixup(free_tree_node_t **ptrRoot, free_tree_node_t *node, free_tree_node_t *parent) {
+    while ((node != *ptrRoot) && !TREE_IS_RED(node)) {
+        if (node == parent->left) {
+            free_tree_node_t *sibling = parent->right; // Exists, its side has a larger black height
+            if (TREE_IS_RED(sibling)) {
+                TREE_SET_BLACK(sibling);
+                TREE_SET_RED(parent);
+                rotateLeft(ptrRoot, parent);
+                sibling = parent->right;
+            }
+            if (!TREE_IS_RED(sibling->left) && !TREE_IS_RED(sibling->right)) {
+                TREE_SET_RED(sibling);
+                node = parent;
+                parent = TREE_PARENT(node);
+            } else {
+                if (!TREE_IS_RED(sibling->right)) {
+                    TREE_SET_BLACK(sibling->left);
+                    TREE_SET_RED(sibling);
+                    rotateRight(ptrRoot, sibling);
+                    sibling = parent->right;
+                }
+                sibling->parentColor = (sibling->parentColor & ~(uintptr_t)TREE_RED) | (parent->parentColor & TREE_RED);
+                TREE_SET_BLACK(parent);
+                TREE_SET_BLACK(sibling->right);
+                rotateLeft(ptrRoot, parent);
+                node = *ptrRoot;
+            }
+        } else {
+            free_tree_node_t *sibling = parent->left;
+            if (TREE_IS_RED(sibling)) {
+                TREE_SET_BLACK(sibling);
+                TREE_SET_RED(parent);
+                rotateRight(ptrRoot, parent);
+                sibling = parent->left;
+            }
+            if (!TREE_IS_RED(sibling->left) && !TREE_IS_RED(sibling->right)) {
+                TREE_SET_RED(sibling);
+                node = parent;
+                parent = TREE_PARENT(node);
+            } else {
+                if (!TREE_IS_RED(sibling->left)) {
+                    TREE_SET_BLACK(sibling->right);
+                    TREE_SET_RED(sibling);
+                    rotateLeft(ptrRoot, sibling);
+                    sibling = parent->left;
+                }
+                sibling->parentColor = (sibling->parentColor & ~(uintptr_t)TREE_RED) | (parent->parentColor & TREE_RED);
+                TREE_SET_BLACK(parent);
+                TREE_SET_BLACK(sibling->left);
+                rotateRight(ptrRoot, parent);
+                node = *ptrRoot;
+            }
+        }
+    }
+    if (NULL != node) {
+        TREE_SET_BLACK(node);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef FREETREE_H  // Include guard to prevent multiple inclusions
+#define FREETREE_H
+
+#include "./../DoubleLinkedList/DoubleLinkedList.h"  // For node_t
+
+#define FREE_INDEX_MIN_CHUNK 48 // Smallest chunk holding a tree node and a footer
+
+/**
+ * @brief Node of the best-fit index, stored in the payload of a free heap chunk
+ *
+ * The nodes form a red-black tree ordered by (chunk size, address), so every key is unique and
+ * the lookup breaks ties on size by taking the lowest address. Chunks are 8 mod 16 aligned,
+ * the low bit of the parent pointer holds the node color.
+ */
+typedef struct free_tree_node {
+  size_t size;                       // Chunk metadata (size and flags)
+  struct free_tree_node *left;       // Smaller keys
+  struct free_tree_node *right;      // Larger keys
+  uintptr_t parentColor;             // Parent node, the low bit is set for red nodes
+} free_tree_node_t;
+
+/**
+ * @brief Free chunk index of the best-fit engine
+ */
+typedef struct free_index {
+  free_tree_node_t *root;            // Root of the red-black tree, NULL when no chunk is free
+  size_t freeNum;                    // Number of indexed chunks
+  size_t freeBytes;                  // Total size of the indexed chunks
+} free_index_t;
+
+#endif  // FREETREE_H
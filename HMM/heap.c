@@ -0,0 +1,762 @@
+/*
+ * File: heap.c
+ * Description: boundary-tag heap of the arenas, shared by the bestfit and tlsf engines which only index its free chunks.
+ * Author: Mohamed Eslam
+ */
+
+#include <sys/mman.h> // For madvise
+#include "hmm.h"
+
+#define HEAP_PAGE_UP(addr) ((uint8_t *)(((uintptr_t)(addr) + getpagesize() - 1) & ~((uintptr_t)getpagesize() - 1))) // Next page boundary
+#define HEAP_PAGE_DOWN(addr) ((uint8_t *)((uintptr_t)(addr) & ~((uintptr_t)getpagesize() - 1))) // Page boundary at or below
+#define HEAP_UNIT_UP(addr, unit) ((uint8_t *)(((uintptr_t)(addr) + (unit) - 1) & ~((uintptr_t)(unit) - 1))) // Next purge unit boundary
+#define HEAP_UNIT_DOWN(addr, unit) ((uint8_t *)((uintptr_t)(addr) & ~((uintptr_t)(unit) - 1))) // Purge unit boundary at or below
+#define HEAP_DIRTY_LINK(chunk) ((node_t *)((uint8_t *)(chunk) + HEAP_MIN_CHUNK)) // Dirty list node of a free chunk, after its index links
+#define HEAP_DIRTY_CHUNK(link) ((node_t *)((uint8_t *)(link) - HEAP_MIN_CHUNK)) // Free chunk of a dirty list node
+#define HEAP_PURGE_START(chunk) ((uint8_t *)HEAP_DIRTY_LINK(chunk) + sizeof(node_t)) // Free chunk memory that may be purged, after its links
+#define HEAP_PURGE_END(chunk) ((uint8_t *)NEXT_CHUNK(chunk) - sizeof(size_t)) // End of that memory, its footer is kept
+
+/**
+ * @brief State of a malloc_trim walk over the free chunks of an arena
+ */
+typedef struct heap_trim {
+  arena_t *arena;          // Arena being trimmed
+  node_t *topNode;         // Free chunk before the fence, kept as the pad, or NULL
+  size_t released;         // Bytes given back to the OS
+} heap_trim_t;
+
+static void splitNode(arena_t *arena, node_t *allocNode, size_t size, uint8_t dirty);
+static node_t * heapGrow(arena_t *arena, size_t size, uint8_t *ptrDirty);
+static void heapClear(arena_t *arena, node_t *chunk, uint8_t *zeroStart);
+static return_status_t heapIndexInsert(arena_t *arena, node_t *chunk, uint8_t dirty);
+static uint8_t heapIndexRemove(arena_t *arena, node_t *chunk);
+static size_t heapDirtyBytes(node_t *chunk);
+static void heapDirtyLink(arena_t *arena, node_t *chunk);
+static void heapDirtyUnlink(arena_t *arena, node_t *chunk);
+static size_t heapShrinkTop(arena_t *arena, node_t *topNode, size_t keep);
+static size_t heapPurge(arena_t *arena, uint8_t *start, uint8_t *end);
+static void heapPurgeChunk(node_t *chunk, void *arg);
+static void heapPurgeDirty(arena_t *arena, node_t *chunk);
+static void heapChunkSort(node_t **chunks, size_t num);
+
+
+/**
+ * @brief Allocates a chunk from the free index of an arena
+ *
+ * This is the medium/large path of malloc. It takes the fit found by the engine index: the best
+ * fit in O(log n) for the red-black tree, a good fit in O(1) for TLSF. The arena heap grows with
+ * heapGrow when no free chunk is large enough. The tail of the chunk that is not needed goes back
+ * to the index.
+ * The chunk after the allocated one gets PREV_INUSE_FLAG, so its footer is not read anymore.
+ * With 'zeroed', the part of the chunk below arena->zeroStart is cleared, the rest is memory that
+ * was never handed out since it came from the OS.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param zeroed Non-zero when the user area must read as zero (calloc)
+ *
+ * @return A pointer to the user area of the chunk, or NULL if the heap could not grow
+ */
+void *heapAlloc(arena_t *arena, size_t size, uint8_t zeroed) {
+    void *retAdd = NULL; // Pointer to the allocated memory, initialized to NULL
+    node_t *allocNode = freeIndexFind(&arena->freeIndex, size); // Fit chosen by the engine
+    uint8_t dirty = 0; // The fit was on the dirty list, so is its remainder
+
+    if (NULL != allocNode) {
+        dirty = heapIndexRemove(arena, allocNode);
+    } else {
+        allocNode = heapGrow(arena, size, &dirty); // No free chunk is large enough, grow the heap
+    }
+
+    if (NULL != allocNode) {
+        uint8_t *zeroStart = arena->zeroStart; // Known-zero memory, before the split moves it
+
+        splitNode(arena, allocNode, size, dirty); // To reduce external fragmentation
+        NEXT_CHUNK(allocNode)->size |= PREV_INUSE_FLAG; // Tell the next chunk this one is in use
+        retAdd = (uint8_t *)allocNode + METADATA_SIZE; // Return address after metadata
+        if (zeroed) {
+            heapClear(arena, allocNode, zeroStart);
+        }
+    }
+    return retAdd;
+}
+
+/**
+ * @brief Allocates several chunks of the same size from the free index of an arena
+ *
+ * The whole run is taken from a single fit (or a single growth of the heap) and carved into
+ * 'num' chunks following each other, only the last one splits the tail of the fit back into the
+ * index. So a burst costs one index lookup and one split instead of one per chunk. When no run
+ * of that size can be found nor grown, the chunks are allocated one at a time.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of every chunk in bytes (metadata included, multiple of 16)
+ * @param num Number of chunks wanted
+ * @param ptrs Receives the pointers to the user areas of the chunks
+ *
+ * @return Number of chunks allocated, less than 'num' only when the heap could not grow
+ */
+size_t heapAllocBatch(arena_t *arena, size_t size, size_t num, void **ptrs) {
+    size_t allocNum = 0;
+    size_t runSize = 0; // Bytes of the whole run
+    node_t *allocNode = NULL;
+    uint8_t dirty = 0;
+
+    if ((num > 1) && !__builtin_mul_overflow(size, num, &runSize)) {
+        allocNode = freeIndexFind(&arena->freeIndex, runSize);
+        if (NULL != allocNode) {
+            dirty = heapIndexRemove(arena, allocNode);
+        } else {
+            allocNode = heapGrow(arena, runSize, &dirty);
+        }
+    }
+
+    if (NULL != allocNode) {
+        size_t restSize = CHUNK_SIZE(allocNode); // Bytes of the fit not carved yet
+        size_t prevInUse = allocNode->size & PREV_INUSE_FLAG;
+
+        // Every chunk but the first one follows an allocated chunk
+        while (allocNum + 1 < num) {
+            allocNode->size = size | prevInUse;
+            ptrs[allocNum++] = (uint8_t *)allocNode + METADATA_SIZE;
+            allocNode = (node_t *)((uint8_t *)allocNode + size);
+            restSize -= size;
+            prevInUse = PREV_INUSE_FLAG;
+        }
+        allocNode->size = restSize | prevInUse;
+        splitNode(arena, allocNode, size, dirty); // The last chunk gives the tail back
+        NEXT_CHUNK(allocNode)->size |= PREV_INUSE_FLAG;
+        ptrs[allocNum++] = (uint8_t *)allocNode + METADATA_SIZE;
+    }
+    while (allocNum < num) {
+        void *ptr = heapAlloc(arena, size, 0);
+        if (NULL == ptr) {
+            break;
+        }
+        ptrs[allocNum++] = ptr;
+    }
+    return allocNum;
+}
+
+/**
+ * @brief Allocates a chunk whose user area is aligned from the free index of an arena
+ *
+ * The fit is large enough to hold the chunk wherever the alignment puts it, plus a free chunk
+ * before it. The head before the aligned chunk goes back to the index, like the tail, so the
+ * alignment costs no memory. The chunk before the head is in use, free chunks never touch.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param alignment Alignment of the user area, a power of two larger than 16
+ *
+ * @return A pointer to the user area of the chunk, or NULL if the heap could not grow
+ */
+void *heapAllocAligned(arena_t *arena, size_t size, size_t alignment) {
+    void *retAdd = NULL;
+    size_t fitSize = 0; // Size of a fit able to hold the chunk once aligned
+    node_t *allocNode = NULL;
+    uint8_t dirty = 0;
+
+    if (size < HEAP_MIN_CHUNK) {
+        size = HEAP_MIN_CHUNK; // The chunk must be able to hold the index links once freed
+    }
+    fitSize = size + alignment + HEAP_MIN_CHUNK;
+    allocNode = freeIndexFind(&arena->freeIndex, fitSize);
+    if (NULL != allocNode) {
+        dirty = heapIndexRemove(arena, allocNode);
+    } else {
+        allocNode = heapGrow(arena, fitSize, &dirty);
+    }
+
+    if (NULL != allocNode) {
+        uint8_t *user = (uint8_t *)(((uintptr_t)allocNode + METADATA_SIZE + alignment - 1) & ~((uintptr_t)alignment - 1));
+
+        if (user != (uint8_t *)allocNode + METADATA_SIZE) {
+            node_t *alignedNode = NULL;
+            size_t headSize = 0;
+
+            while ((size_t)(user - METADATA_SIZE - (uint8_t *)allocNode) < HEAP_MIN_CHUNK) {
+                user += alignment; // The head must be able to hold the index links
+            }
+            alignedNode = (node_t *)(user - METADATA_SIZE);
+            headSize = (uint8_t *)alignedNode - (uint8_t *)allocNode;
+            alignedNode->size = CHUNK_SIZE(allocNode) - headSize; // Its previous chunk, the head, is free
+            allocNode->size = headSize | (allocNode->size & PREV_INUSE_FLAG);
+            CHUNK_FOOTER(allocNode) = headSize;
+            heapIndexInsert(arena, allocNode, dirty);
+            allocNode = alignedNode;
+        }
+        splitNode(arena, allocNode, size, dirty);
+        NEXT_CHUNK(allocNode)->size |= PREV_INUSE_FLAG; // Tell the next chunk this one is in use
+        retAdd = user;
+    }
+    return retAdd;
+}
+
+/**
+ * @brief Returns a chunk to the free index of an arena
+ *
+ * The physical neighbours are found in constant time through the boundary tags: the chunk
+ * metadata tells whether the previous chunk is free (PREV_INUSE_FLAG) and the footer of a free
+ * chunk gives its size. Merged neighbours are removed from the free index and the result is
+ * inserted in it, in O(log n) or O(1) depending on the engine.
+ * With a decay time (HMM_DIRTY_DECAY_MS, 10 s by default), nothing is given back here: the merged
+ * chunk goes to the tail of the dirty list and the pages it gained are added to the decay backlog.
+ * heapDecay purges the oldest dirty chunks once their time has come, from the background thread
+ * or from every DECAY_TICK_NUM-th call of this function, so memory freed and reused quickly stays
+ * warm and the heap top is not shrunk and grown over and over.
+ * With a decay time of 0 the memory is given back at once above the trim threshold (MIN_FREE_SBRK
+ * by default): when a free chunk ending at the heap fence exceeds one growth step by the threshold,
+ * the pages above that step are released to the OS, they come back zeroed when the heap grows
+ * again; any other free chunk reaching the threshold stays indexed but the whole pages of the chunk
+ * just freed are purged with MADV_DONTNEED, so a live chunk above it does not pin them in the RSS.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the chunk
+ * @param ptrFreeNode Pointer to the chunk metadata
+ *
+ * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ */
+return_status_t heapFree(arena_t *arena, node_t *ptrFreeNode) {
+    return_status_t ret = OK; // Return status for function calls
+    size_t freeSize = CHUNK_SIZE(ptrFreeNode); // Size of the free chunk after merging
+    node_t *nextNode = NEXT_CHUNK(ptrFreeNode); // Physically next chunk
+    uint8_t *freedStart = (uint8_t *)ptrFreeNode; // Memory freed by this call, before merging
+    uint8_t *freedEnd = (uint8_t *)nextNode;
+    uint64_t decayMs = TUNE_GET(dirtyDecayMs);
+    size_t dirtyBytes = arena->dirtyBytes; // Dirty list before the merges
+    uint8_t dirty = 0; // A neighbour was on the dirty list
+
+    // Merge with the previous chunk, its footer gives its size
+    if (0 == (ptrFreeNode->size & PREV_INUSE_FLAG)) {
+        node_t *prevNode = PREV_CHUNK(ptrFreeNode);
+        dirty |= heapIndexRemove(arena, prevNode);
+        freeSize += CHUNK_SIZE(prevNode);
+        ptrFreeNode = prevNode;
+    }
+    // Merge with the next chunk, it is free when the chunk after it does not have PREV_INUSE_FLAG
+    if ((0 != CHUNK_SIZE(nextNode)) && (0 == (NEXT_CHUNK(nextNode)->size & PREV_INUSE_FLAG))) {
+        dirty |= heapIndexRemove(arena, nextNode);
+        freeSize += CHUNK_SIZE(nextNode);
+    }
+
+    ptrFreeNode->size = freeSize | (ptrFreeNode->size & PREV_INUSE_FLAG);
+    CHUNK_FOOTER(ptrFreeNode) = freeSize;
+    nextNode = NEXT_CHUNK(ptrFreeNode);
+    nextNode->size &= ~(size_t)PREV_INUSE_FLAG; // Tell the next chunk this one is free
+
+    if (0 != decayMs) {
+        dirty = 1; // The pages just freed wait for the decay
+    } else if (nextNode != HEAP_FENCE(arena->programBreak)) {
+        if (freeSize >= TUNE_GET(trimThreshold)) {
+            // Keep the metadata, index links and footer of the merged chunk
+            uint8_t *chunkStart = HEAP_PURGE_START(ptrFreeNode);
+            uint8_t *chunkEnd = HEAP_PURGE_END(ptrFreeNode);
+            heapPurge(arena, (freedStart > chunkStart) ? freedStart : chunkStart, (freedEnd < chunkEnd) ? freedEnd : chunkEnd);
+        }
+    } else if (freeSize >= TUNE_GET(trimThreshold) + TUNE_GET(growSize)) {
+        heapShrinkTop(arena, ptrFreeNode, TUNE_GET(growSize)); // Keep one growth step
+    }
+    ret = heapIndexInsert(arena, ptrFreeNode, dirty); // Index it by size for the next allocations
+
+    if (arena->dirtyBytes > dirtyBytes) {
+        arena->decay.backlog[0] += arena->dirtyBytes - dirtyBytes;
+    }
+    if ((0 != arena->dirtyBytes) && !__atomic_load_n(&decayThreadRunning, __ATOMIC_ACQUIRE) &&
+        (++arena->decay.tick >= DECAY_TICK_NUM)) {
+        arena->decay.tick = 0;
+        heapDecay(arena, decayNow());
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns several chunks to the free index of an arena
+ *
+ * The chunks are sorted by address first, so the ones following each other in memory (a run
+ * carved by heapAllocBatch, or neighbours freed together) are found in one sweep. Each such run becomes a
+ * single chunk freed with one heapFree: one merge with its free neighbours and one index insertion
+ * instead of one per chunk.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning every chunk
+ * @param chunks Pointers to the chunk metadata, sorted in place
+ * @param num Number of chunks, at most BATCH_FREE_NUM
+ *
+ * @return return_status_t indicating success (OK) or error (NOK) when a chunk could not be freed.
+ */
+return_status_t heapFreeBatch(arena_t *arena, node_t **chunks, size_t num) {
+    return_status_t ret = OK;
+    size_t i = 0;
+
+    heapChunkSort(chunks, num);
+    while (i < num) {
+        node_t *runNode = chunks[i];
+        size_t runSize = CHUNK_SIZE(runNode);
+
+        while ((i + 1 < num) && ((uint8_t *)runNode + runSize == (uint8_t *)chunks[i + 1])) {
+            runSize += CHUNK_SIZE(chunks[++i]);
+        }
+        runNode->size = runSize | (runNode->size & PREV_INUSE_FLAG);
+        if (OK != heapFree(arena, runNode)) {
+            ret = NOK;
+        }
+        i++;
+    }
+    return ret;
+}
+
+/**
+ * @brief Resizes an allocated chunk without moving it
+ *
+ * A shrink splits the tail off and frees it, so it merges with a free next chunk (or is released
+ * at the heap end). A growth absorbs the next chunk when it is free and large enough, or extends
+ * the heap when the chunk is the last one before the fence; the part that is not needed is split
+ * off again. Any other growth fails and the caller moves the data.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Pointer to the metadata of an allocated chunk
+ * @param size New size of the chunk in bytes (metadata included, multiple of 16)
+ *
+ * @return return_status_t indicating success (OK) or error (NOK) when the chunk cannot grow in place.
+ */
+return_status_t heapResize(arena_t *arena, node_t *chunk, size_t size) {
+    return_status_t ret = NOK;
+    size_t oldSize = CHUNK_SIZE(chunk);
+    node_t *nextNode = NEXT_CHUNK(chunk);
+
+    if (size < HEAP_MIN_CHUNK) {
+        size = HEAP_MIN_CHUNK; // The chunk must be able to hold the index links once freed
+    }
+
+    if (size <= oldSize) {
+        if (oldSize - size >= HEAP_MIN_CHUNK) {
+            node_t *restNode = (node_t *)((uint8_t *)chunk + size);
+            restNode->size = (oldSize - size) | PREV_INUSE_FLAG; // Looks allocated until it is freed
+            chunk->size = size | (chunk->size & PREV_INUSE_FLAG);
+            heapFree(arena, restNode);
+        }
+        ret = OK;
+    } else {
+        node_t *freeNode = NULL; // Free chunk right after 'chunk', not indexed
+        uint8_t dirty = 0;
+
+        if ((0 != CHUNK_SIZE(nextNode)) && (0 == (NEXT_CHUNK(nextNode)->size & PREV_INUSE_FLAG))) {
+            if (oldSize + CHUNK_SIZE(nextNode) >= size) {
+                dirty = heapIndexRemove(arena, nextNode);
+                freeNode = nextNode;
+            }
+        } else if (nextNode == HEAP_FENCE(arena->programBreak)) {
+            // The chunk ends the heap, extend it: the old fence becomes the new free chunk
+            freeNode = heapGrow(arena, size - oldSize, &dirty);
+            if ((NULL != freeNode) && (freeNode != nextNode)) {
+                heapIndexInsert(arena, freeNode, dirty); // New segment, not contiguous
+                freeNode = NULL;
+            }
+        }
+        if (NULL != freeNode) {
+            chunk->size = (oldSize + CHUNK_SIZE(freeNode)) | (chunk->size & PREV_INUSE_FLAG);
+            splitNode(arena, chunk, size, dirty);
+            NEXT_CHUNK(chunk)->size |= PREV_INUSE_FLAG; // Tell the next chunk this one is in use
+            ret = OK;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns the size of the largest free chunk, for the statistics
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to inspect
+ *
+ * @return Size of the largest free chunk in bytes, 0 if there is none
+ */
+size_t heapLargestFree(arena_t *arena) {
+    return freeIndexLargest(&arena->freeIndex);
+}
+
+/**
+ * @brief Gives the free memory of an arena back to the OS, for malloc_trim
+ *
+ * The free chunk before the fence is shrunk to 'pad' bytes and the heap end moves down to it.
+ * Every other free chunk stays indexed, its whole pages are purged with MADV_DONTNEED.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to trim
+ * @param pad Free bytes kept at the top of the heap
+ *
+ * @return Number of bytes given back to the OS
+ */
+size_t heapTrim(arena_t *arena, size_t pad) {
+    heap_trim_t trim = {arena, NULL, 0};
+
+    if (NULL != arena->programBreak) {
+        node_t *fenceNode = HEAP_FENCE(arena->programBreak);
+
+        if (0 == (fenceNode->size & PREV_INUSE_FLAG)) {
+            uint8_t dirty = 0;
+
+            trim.topNode = PREV_CHUNK(fenceNode);
+            dirty = heapIndexRemove(arena, trim.topNode); // Its size changes
+            trim.released += heapShrinkTop(arena, trim.topNode, (pad > HEAP_MIN_CHUNK) ? pad : HEAP_MIN_CHUNK);
+            heapIndexInsert(arena, trim.topNode, dirty); // The pad may stay dirty
+        }
+    }
+    freeIndexWalk(&arena->freeIndex, heapPurgeChunk, &trim);
+    return trim.released;
+}
+
+/**
+ * @brief Purges the oldest dirty free memory of an arena above the limit of the decay curve
+ *
+ * Once per epoch, the dirty list is purged from its head (the chunks dirtied first) until its
+ * bytes fit under the limit decayAdvance computes from the backlog. The chunk before the fence
+ * gives its pages back by moving the heap end down, the others with MADV_DONTNEED.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to purge
+ * @param now Current time from decayNow
+ *
+ * @return Nothing
+ */
+void heapDecay(arena_t *arena, uint64_t now) {
+    size_t limit = 0;
+
+    if (decayAdvance(&arena->decay, now, &limit)) {
+        while ((arena->dirtyBytes > limit) && (NULL != arena->dirtyList.head)) {
+            heapPurgeDirty(arena, HEAP_DIRTY_CHUNK(arena->dirtyList.head));
+        }
+    }
+}
+
+/**
+ * @brief Splits the tail of a chunk taken for an allocation back into the free index
+ *
+ * The allocation keeps the beginning of the chunk, so a chunk carved from fresh memory leaves
+ * the free remainder next to the heap end, where it can be released to the OS. Nothing is split
+ * when the remainder would be smaller than HEAP_MIN_CHUNK, the allocation keeps it.
+ * The known-zero memory of the arena now starts after the index links of the remainder.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the chunk
+ * @param allocNode Free chunk (not indexed) of at least 'size' bytes
+ * @param size Size of the allocated chunk in bytes
+ * @param dirty Non-zero when the chunk came from the dirty list, the remainder goes back to it
+ */
+static void splitNode(arena_t *arena, node_t *allocNode, size_t size, uint8_t dirty) {
+    size_t restSize = CHUNK_SIZE(allocNode) - size;
+    uint8_t *dirtyEnd = NULL; // End of the memory the allocation and the remainder may have written
+
+    if (restSize >= HEAP_MIN_CHUNK) {
+        node_t *restNode = (node_t *)((uint8_t *)allocNode + size);
+        restNode->size = restSize | PREV_INUSE_FLAG; // Its previous chunk is the allocated one
+        CHUNK_FOOTER(restNode) = restSize;
+        allocNode->size = size | (allocNode->size & PREV_INUSE_FLAG);
+        heapIndexInsert(arena, restNode, dirty);
+    }
+    // Only the top chunk can reach arena->zeroStart, and only in the current heap segment
+    dirtyEnd = (uint8_t *)NEXT_CHUNK(allocNode) + HEAP_MIN_CHUNK; // Its dirty links are handled by heapDirtyLink
+    if ((arena->zeroStart < dirtyEnd) && ((uint8_t *)NEXT_CHUNK(allocNode) < (uint8_t *)arena->programBreak)) {
+        arena->zeroStart = dirtyEnd;
+    }
+}
+
+/**
+ * @brief Grows the heap of an arena by enough growth steps (SBRK_ALLOC_SIZE by default) to hold a chunk
+ *
+ * The heap always ends with a fence: a zero-sized chunk that is never free, so the last chunk
+ * can read the in-use state of its next neighbour. When the new memory directly follows the
+ * heap, the old fence becomes the metadata of the new chunk, which is merged with the free
+ * chunk before it, if any. Otherwise (new region) the new memory starts a new heap segment.
+ * The new memory is zero, arena->zeroStart moves to its start (after the old fence), or to the
+ * first page of a new segment. In THP mode the growth step is rounded up to a whole huge page.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to grow
+ * @param size Size of the chunk that must fit in the new memory
+ * @param ptrDirty Set when the free chunk merged with the new memory was on the dirty list
+ *
+ * @return Free chunk (not indexed) of at least 'size' bytes, or NULL on failure
+ */
+static node_t * heapGrow(arena_t *arena, size_t size, uint8_t *ptrDirty) {
+    uint8_t *oldEnd = (uint8_t *)arena->programBreak;
+    size_t unit = ARENA_PURGE_UNIT();
+    size_t growSize = (TUNE_GET(growSize) + unit - 1) & ~(unit - 1);
+    // Room for the alignment of a new segment and its fence
+    size_t sbrkNum = (size + HEAP_MIN_CHUNK + growSize - 1) / growSize;
+    uint8_t *newMem = arenaMoreCore(arena, sbrkNum * growSize);
+    node_t *newNode = NULL;
+
+    if (NULL != newMem) {
+        node_t *fenceNode = HEAP_FENCE(newMem + sbrkNum * growSize);
+
+        if ((NULL != oldEnd) && (newMem == oldEnd)) {
+            // The old fence becomes the metadata of the new chunk
+            newNode = HEAP_FENCE(oldEnd);
+            newNode->size = ((uint8_t *)fenceNode - (uint8_t *)newNode) | (newNode->size & PREV_INUSE_FLAG);
+            if (0 == (newNode->size & PREV_INUSE_FLAG)) {
+                node_t *prevNode = PREV_CHUNK(newNode);
+                *ptrDirty = heapIndexRemove(arena, prevNode);
+                prevNode->size += CHUNK_SIZE(newNode);
+                newNode = prevNode;
+            }
+            if (arena->zeroStart < oldEnd) {
+                arena->zeroStart = oldEnd; // The old fence and footer are now inside the chunk
+            }
+        } else {
+            // New segment, nothing before its first chunk can be merged
+            newNode = (node_t *)((((uintptr_t)newMem + 15) & ~(uintptr_t)15) + 8);
+            newNode->size = ((uint8_t *)fenceNode - (uint8_t *)newNode) | PREV_INUSE_FLAG;
+            // The break may start in a page kept by an earlier shrink of the heap
+            arena->zeroStart = HEAP_PAGE_UP((uint8_t *)newNode + HEAP_MIN_CHUNK);
+        }
+        CHUNK_FOOTER(newNode) = CHUNK_SIZE(newNode);
+        fenceNode->size = 0; // The chunk before the fence is free
+    }
+    return newNode;
+}
+
+/**
+ * @brief Clears the user area of a chunk allocated for calloc
+ *
+ * Everything in the current heap segment from 'zeroStart' to the fence is zero but the footer
+ * of the top chunk, so only the user area below 'zeroStart' and its last word are cleared.
+ * A chunk of another segment is cleared entirely.
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Allocated chunk
+ * @param zeroStart Value of arena->zeroStart before the chunk was split off
+ */
+static void heapClear(arena_t *arena, node_t *chunk, uint8_t *zeroStart) {
+    uint8_t *userStart = (uint8_t *)chunk + METADATA_SIZE;
+    uint8_t *userEnd = (uint8_t *)NEXT_CHUNK(chunk);
+    uint8_t *dirtyEnd = userEnd; // End of the part that may hold old data
+
+    if ((zeroStart < userEnd) && (userEnd <= (uint8_t *)arena->programBreak)) {
+        dirtyEnd = (zeroStart > userStart) ? zeroStart : userStart;
+        *((size_t *)userEnd - 1) = 0; // Footer of the top chunk
+    }
+    memset(userStart, 0, dirtyEnd - userStart);
+}
+
+/**
+ * @brief Gives the whole pages of a range of free memory back to the OS
+ *
+ * The chunk holding them stays free, the pages are faulted in again, zeroed, on their next use.
+ * In THP mode only whole huge pages are purged, so a huge page is never split by the kernel.
+ *
+ * @param arena Arena owning the memory
+ * @param start Start of the range
+ * @param end End of the range
+ *
+ * @return Number of bytes purged
+ */
+static size_t heapPurge(arena_t *arena, uint8_t *start, uint8_t *end) {
+    size_t purged = 0;
+    size_t unit = ARENA_PURGE_UNIT();
+    uint8_t *pageStart = HEAP_UNIT_UP(start, unit);
+    uint8_t *pageEnd = HEAP_UNIT_DOWN(end, unit);
+
+    if ((pageStart < pageEnd) && (0 == madvise(pageStart, pageEnd - pageStart, MADV_DONTNEED))) {
+        purged = pageEnd - pageStart;
+        arena->trimNum++;
+    }
+    return purged;
+}
+
+/**
+ * @brief freeIndexWalk visitor of heapTrim, purges the whole pages of a free chunk
+ *
+ * @param chunk Free chunk
+ * @param arg The heap_trim_t of the walk
+ */
+static void heapPurgeChunk(node_t *chunk, void *arg) {
+    heap_trim_t *trim = (heap_trim_t *)arg;
+
+    if (chunk != trim->topNode) {
+        if (0 != (chunk->size & DIRTY_CHUNK_FLAG)) {
+            heapDirtyUnlink(trim->arena, chunk); // Clean once purged
+        }
+        trim->released += heapPurge(trim->arena, HEAP_PURGE_START(chunk), HEAP_PURGE_END(chunk));
+    }
+}
+
+/**
+ * @brief Inserts a free chunk in the free index and, when its pages may be dirty, in the dirty list
+ *
+ * Chunks without a whole page to purge are never put on the dirty list.
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Free chunk, not indexed
+ * @param dirty Non-zero when the pages of the chunk may be resident
+ *
+ * @return return_status_t of the index insertion
+ */
+static return_status_t heapIndexInsert(arena_t *arena, node_t *chunk, uint8_t dirty) {
+    return_status_t ret = freeIndexInsert(&arena->freeIndex, chunk);
+
+    if (dirty && (0 != heapDirtyBytes(chunk))) {
+        heapDirtyLink(arena, chunk);
+    }
+    return ret;
+}
+
+/**
+ * @brief Removes a free chunk from the free index and from the dirty list
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Indexed free chunk
+ *
+ * @return 1 when the chunk was on the dirty list, 0 otherwise
+ */
+static uint8_t heapIndexRemove(arena_t *arena, node_t *chunk) {
+    uint8_t dirty = 0;
+
+    freeIndexRemove(&arena->freeIndex, chunk);
+    if (0 != (chunk->size & DIRTY_CHUNK_FLAG)) {
+        heapDirtyUnlink(arena, chunk);
+        dirty = 1;
+    }
+    return dirty;
+}
+
+/**
+ * @brief Returns the bytes of the whole pages (huge pages in THP mode) a free chunk could purge
+ *
+ * @param chunk Free chunk
+ *
+ * @return Number of bytes, 0 when no whole page lies between its links and its footer
+ */
+static size_t heapDirtyBytes(node_t *chunk) {
+    size_t unit = ARENA_PURGE_UNIT();
+    uint8_t *pageStart = HEAP_UNIT_UP(HEAP_PURGE_START(chunk), unit);
+    uint8_t *pageEnd = HEAP_UNIT_DOWN(HEAP_PURGE_END(chunk), unit);
+
+    return (pageStart < pageEnd) ? (size_t)(pageEnd - pageStart) : 0;
+}
+
+/**
+ * @brief Appends a free chunk to the tail of the dirty list
+ *
+ * The links are written after the index links, so the known-zero memory of the arena moves past
+ * them when the chunk is the top one. The size field of the link keeps the bytes counted in
+ * arena->dirtyBytes, which heapDirtyUnlink takes back even if the purge unit changed meanwhile.
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Free chunk holding at least one whole page to purge
+ */
+static void heapDirtyLink(arena_t *arena, node_t *chunk) {
+    node_t *link = HEAP_DIRTY_LINK(chunk);
+    uint8_t *linksEnd = (uint8_t *)(link + 1);
+
+    chunk->size |= DIRTY_CHUNK_FLAG;
+    link->size = heapDirtyBytes(chunk);
+    listPushBack(&arena->dirtyList, link);
+    arena->dirtyBytes += link->size;
+    if ((arena->zeroStart < linksEnd) && (linksEnd <= (uint8_t *)arena->programBreak)) {
+        arena->zeroStart = linksEnd;
+    }
+}
+
+/**
+ * @brief Removes a free chunk from the dirty list
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Chunk on the dirty list, its size did not change since it was linked
+ */
+static void heapDirtyUnlink(arena_t *arena, node_t *chunk) {
+    listRemove(&arena->dirtyList, HEAP_DIRTY_LINK(chunk));
+    arena->dirtyBytes -= HEAP_DIRTY_LINK(chunk)->size;
+    chunk->size &= ~(size_t)DIRTY_CHUNK_FLAG;
+}
+
+/**
+ * @brief Releases the whole pages of the free chunk before the fence above 'keep' bytes
+ *
+ * The heap end moves down, the pages come back zeroed when the heap grows again. In THP mode
+ * whole huge pages are released, the heap end stays on a huge page boundary.
+ *
+ * @param arena Arena owning the chunk
+ * @param topNode Free chunk ending at the fence, not indexed
+ * @param keep Bytes the chunk keeps, at least HEAP_MIN_CHUNK
+ *
+ * @return Number of bytes released
+ */
+static size_t heapShrinkTop(arena_t *arena, node_t *topNode, size_t keep) {
+    size_t release = 0;
+
+    if (CHUNK_SIZE(topNode) > keep) {
+        release = (CHUNK_SIZE(topNode) - keep) & ~(ARENA_PURGE_UNIT() - 1);
+    }
+    if ((0 != release) && (NULL != arenaMoreCore(arena, -(intptr_t)release))) {
+        size_t topSize = CHUNK_SIZE(topNode) - release;
+
+        topNode->size = topSize | (topNode->size & PREV_INUSE_FLAG);
+        CHUNK_FOOTER(topNode) = topSize;
+        NEXT_CHUNK(topNode)->size = 0; // The new fence, zeroStart still holds: the kept pages did not change
+    } else {
+        release = 0;
+    }
+    return release;
+}
+
+/**
+ * @brief Purges a chunk of the dirty list, which leaves it
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Chunk on the dirty list
+ */
+static void heapPurgeDirty(arena_t *arena, node_t *chunk) {
+    if (NEXT_CHUNK(chunk) == HEAP_FENCE(arena->programBreak)) {
+        heapIndexRemove(arena, chunk); // Its size changes
+        heapShrinkTop(arena, chunk, HEAP_MIN_CHUNK);
+        heapIndexInsert(arena, chunk, 0);
+    } else {
+        heapDirtyUnlink(arena, chunk);
+        heapPurge(arena, HEAP_PURGE_START(chunk), HEAP_PURGE_END(chunk));
+    }
+}
+
+/**
+ * @brief Sorts chunk pointers by address, for heapFreeBatch
+ *
+ * A shellsort with the gaps of Ciura: the comparisons are inlined, which makes it several times
+ * faster than qsort on the few hundred chunks of a batch, and it needs no memory.
+ *
+ * @param chunks Chunk pointers, sorted in place
+ * @param num Number of chunks, at most BATCH_FREE_NUM
+ */
+static void heapChunkSort(node_t **chunks, size_t num) {
+    static const size_t gaps[] = {132, 57, 23, 10, 4, 1};
+
+    for (size_t g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++) {
+        size_t gap = gaps[g];
+
+        for (size_t i = gap; i < num; i++) {
+            node_t *chunk = chunks[i];
+            size_t j = i;
+
+            while ((j >= gap) && (chunks[j - gap] > chunk)) {
+                chunks[j] = chunks[j - gap];
+                j -= gap;
+            }
+            chunks[j] = chunk;
+        }
+    }
+}
@@ -0,0 +1,142 @@
+#ifndef HEAP_H  // Include guard to prevent multiple inclusions
+#define HEAP_H
+
+#include "arena.h"  // Every heap belongs to an arena
+
+/*
+ * Heap engine serving the medium/large chunks of the arenas, selected at build time with
+ * make ENGINE=...: bestfit and tlsf share the boundary-tag heap of heap.c and only differ by the
+ * index of its free chunks (freeindex.h), buddy replaces the whole heap (buddy.c).
+ */
+
+#define DIRTY_CHUNK_FLAG 0x8 // Set in the metadata of a free heap chunk on the dirty list of its arena
+
+#if defined(HMM_ENGINE_BUDDY)
+#define HEAP_CHUNK_BYTES(chunk) BUDDY_CHUNK_BYTES(chunk) // Heap bytes taken by an allocated chunk, its block
+#define HEAP_USABLE_SIZE(chunk) BUDDY_CHUNK_BYTES(chunk) // User bytes of an allocated chunk, its whole block
+#else
+#define HEAP_CHUNK_BYTES(chunk) CHUNK_SIZE(chunk) // Heap bytes taken by an allocated chunk, its metadata included
+#define HEAP_USABLE_SIZE(chunk) (CHUNK_SIZE(chunk) - METADATA_SIZE) // User bytes of an allocated chunk
+#endif
+
+/**
+ * @brief Allocates a chunk from the heap of an arena
+ *
+ * With 'zeroed', the engine clears the user area, skipping the memory it knows to be zero.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param zeroed Non-zero when the user area must read as zero (calloc)
+ *
+ * @return A pointer to the user area of the chunk, or NULL if the heap could not grow
+ */
+void *heapAlloc(arena_t *arena, size_t size, uint8_t zeroed);
+
+/**
+ * @brief Allocates several chunks of the same size from the heap of an arena, for hmm_malloc_batch
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of every chunk in bytes (metadata included, multiple of 16)
+ * @param num Number of chunks wanted
+ * @param ptrs Receives the pointers to the user areas of the chunks
+ *
+ * @return Number of chunks allocated, less than 'num' only when the heap could not grow
+ */
+size_t heapAllocBatch(arena_t *arena, size_t size, size_t num, void **ptrs);
+
+/**
+ * @brief Allocates a chunk whose user area is aligned from the heap of an arena
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param alignment Alignment of the user area, a power of two larger than 16
+ *
+ * @return A pointer to the user area of the chunk, or NULL if the heap could not grow
+ */
+void *heapAllocAligned(arena_t *arena, size_t size, size_t alignment);
+
+/**
+ * @brief Returns a chunk to the heap of an arena
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the chunk
+ * @param ptrFreeNode Pointer to the chunk metadata
+ *
+ * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ */
+return_status_t heapFree(arena_t *arena, node_t *ptrFreeNode);
+
+/**
+ * @brief Returns several chunks to the heap of an arena, for hmm_free_batch
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning every chunk
+ * @param chunks Pointers to the chunk metadata, in any order, the engine may reorder them
+ * @param num Number of chunks, at most BATCH_FREE_NUM
+ *
+ * @return return_status_t indicating success (OK) or error (NOK) when a chunk could not be freed.
+ */
+return_status_t heapFreeBatch(arena_t *arena, node_t **chunks, size_t num);
+
+/**
+ * @brief Resizes an allocated chunk without moving it
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena owning the chunk
+ * @param chunk Pointer to the metadata of an allocated chunk
+ * @param size New size of the chunk in bytes (metadata included, multiple of 16)
+ *
+ * @return return_status_t indicating success (OK) or error (NOK) when the chunk cannot grow in place.
+ */
+return_status_t heapResize(arena_t *arena, node_t *chunk, size_t size);
+
+/**
+ * @brief Returns the size of the largest free chunk of an arena, for the statistics
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to inspect
+ *
+ * @return Size of the largest free chunk in bytes, 0 if there is none
+ */
+size_t heapLargestFree(arena_t *arena);
+
+/**
+ * @brief Gives the free memory of an arena back to the OS, for malloc_trim
+ *
+ * The free memory at the top of the heap is released down to 'pad' bytes, the whole pages of
+ * the other free chunks are purged, they stay free.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to trim
+ * @param pad Free bytes kept at the top of the heap
+ *
+ * @return Number of bytes given back to the OS
+ */
+size_t heapTrim(arena_t *arena, size_t pad);
+
+/**
+ * @brief Purges the oldest dirty free memory of an arena above the limit of the decay curve
+ *
+ * Called once per epoch by the background thread, or every DECAY_TICK_NUM heap frees.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to purge
+ * @param now Current time from decayNow
+ *
+ * @return Nothing
+ */
+void heapDecay(arena_t *arena, uint64_t now);
+
+#endif  // HEAP_H
@@ -0,0 +1,295 @@
+/*
+ * File: histogram.c
+ * Description: per-thread log-linear latency histograms of malloc, free, calloc and realloc,
+ *              only built with make HISTOGRAM=1.
+ * Author: Mohamed Eslam
+ */
+
+#include <fcntl.h> // For open
+#include <stdio.h> // For snprintf
+#include <limits.h> // For PATH_MAX
+#include <stdlib.h> // For getenv and atexit
+#include <sys/mman.h> // For mmap
+#include "hmm.h"
+
+static hist_block_t *histBlockGet(void);
+static void histRelease(void *arg);
+static uint32_t histBucket(uint64_t ticks);
+static uint64_t histBucketMax(uint32_t bucket);
+static uint64_t histPercentile(const uint64_t *count, uint64_t total, uint64_t rank);
+static double histNsPerTick(void);
+static void histDumpAtExit(void);
+
+static __thread hist_block_t *threadHist __attribute__((tls_model("initial-exec"))); // Block of the calling thread
+static hist_block_t *histBlockList = NULL; // Every block ever mapped, never unmapped
+static pthread_key_t histKey; // Its destructor releases the block of an exiting thread
+static uint8_t histKeyReady = 0; // Set once histKey was created
+static uint64_t histStartTicks = 0; // Tick count at startup, base of the tick calibration
+static struct timespec histStartTime; // Monotonic time at startup
+static char histFile[PATH_MAX]; // Value of HMM_HISTOGRAM_FILE, empty when not set
+static pthread_mutex_t histDumpLock = PTHREAD_MUTEX_INITIALIZER; // Serializes the reports
+static hist_block_t histTotal; // Sum of every block, built by the report under histDumpLock
+
+static const char *const histOpName[HIST_OP_NUM] = {"malloc", "free", "calloc", "realloc"};
+static const char *const histBandName[HIST_BAND_NUM] = {"<=520", "<=128K", ">128K"};
+
+
+/**
+ * @brief Prepares the histograms, called once from the library constructor
+ *
+ * Creates the key releasing the block of an exiting thread, starts the tick calibration and,
+ * when HMM_HISTOGRAM_FILE is set, writes the report to that file at exit.
+ *
+ * @return Nothing
+ */
+void histInit(void) {
+    const char *file = getenv(HIST_FILE_ENV);
+
+    if (0 == pthread_key_create(&histKey, histRelease)) {
+        histKeyReady = 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &histStartTime);
+    histStartTicks = histNow();
+    if ((NULL != file) && ('\0' != file[0]) && (strlen(file) < sizeof(histFile))) {
+        strcpy(histFile, file); // Copied, the program may change its environment
+        atexit(histDumpAtExit);
+    }
+}
+
+/**
+ * @brief Records the duration of a call in the histograms of the calling thread
+ *
+ * Only the calling thread writes its block, the update is two plain increments.
+ *
+ * @param op Operation (HIST_MALLOC, HIST_FREE, HIST_CALLOC or HIST_REALLOC)
+ * @param size User size of the call, selects the size band
+ * @param ticks Duration of the call in ticks
+ *
+ * @return Nothing
+ */
+void histRecord(uint32_t op, size_t size, uint64_t ticks) {
+    hist_block_t *block = threadHist;
+
+    if (NULL == block) {
+        block = histBlockGet();
+    }
+    if (NULL != block) {
+        uint32_t band = HIST_BAND(size);
+        block->count[op][band][histBucket(ticks)]++;
+        if (ticks > block->max[op][band]) {
+            block->max[op][band] = ticks;
+        }
+    }
+}
+
+/**
+ * @brief Writes the latency report of every operation and size band
+ *
+ * One line per operation and size band that saw a call: the number of calls, then p50, p99,
+ * p99.9 and max in nanoseconds. The percentiles are the upper bounds of their buckets, at most
+ * 12.5% above the exact value. The report is formatted on the stack and written with write(),
+ * so it can be called from anywhere, a signal handler excepted.
+ *
+ * @param fd File descriptor to write the report to
+ *
+ * @return Nothing
+ */
+void hmm_histogram_dump(int fd) {
+    char line[160];
+    int len = 0;
+    double nsPerTick = histNsPerTick();
+
+    pthread_mutex_lock(&histDumpLock);
+    memset(&histTotal, 0, sizeof(histTotal));
+    for (hist_block_t *block = __atomic_load_n(&histBlockList, __ATOMIC_ACQUIRE); NULL != block; block = block->next) {
+        for (uint32_t op = 0; op < HIST_OP_NUM; op++) {
+            for (uint32_t band = 0; band < HIST_BAND_NUM; band++) {
+                for (uint32_t i = 0; i < HIST_BUCKET_NUM; i++) {
+                    histTotal.count[op][band][i] += block->count[op][band][i];
+                }
+                if (block->max[op][band] > histTotal.max[op][band]) {
+                    histTotal.max[op][band] = block->max[op][band];
+                }
+            }
+        }
+    }
+
+    len = snprintf(line, sizeof(line), "%-8s %-7s %12s %9s %9s %9s %9s (ns)\n",
+                   "op", "size", "calls", "p50", "p99", "p99.9", "max");
+    write(fd, line, len);
+    for (uint32_t op = 0; op < HIST_OP_NUM; op++) {
+        for (uint32_t band = 0; band < HIST_BAND_NUM; band++) {
+            const uint64_t *count = histTotal.count[op][band];
+            uint64_t total = 0;
+
+            for (uint32_t i = 0; i < HIST_BUCKET_NUM; i++) {
+                total += count[i];
+            }
+            if (0 != total) {
+                uint64_t max = histTotal.max[op][band];
+                // Ranks rounded up, so a percentile is never below the calls it stands for
+                uint64_t p50 = histPercentile(count, total, (total * 500 + 999) / 1000);
+                uint64_t p99 = histPercentile(count, total, (total * 990 + 999) / 1000);
+                uint64_t p999 = histPercentile(count, total, (total * 999 + 999) / 1000);
+
+                len = snprintf(line, sizeof(line), "%-8s %-7s %12llu %9.0f %9.0f %9.0f %9.0f\n",
+                               histOpName[op], histBandName[band], (unsigned long long)total,
+                               ((p50 < max) ? p50 : max) * nsPerTick, ((p99 < max) ? p99 : max) * nsPerTick,
+                               ((p999 < max) ? p999 : max) * nsPerTick, max * nsPerTick);
+                write(fd, line, len);
+            }
+        }
+    }
+    pthread_mutex_unlock(&histDumpLock);
+}
+
+/**
+ * @brief Gives the calling thread a block, reusing the one of an exited thread when possible
+ *
+ * A new block is mapped rather than allocated, the histograms must not recurse into malloc.
+ *
+ * @return The block of the calling thread, or NULL if mmap failed
+ */
+static hist_block_t *histBlockGet(void) {
+    hist_block_t *block = __atomic_load_n(&histBlockList, __ATOMIC_ACQUIRE);
+
+    while ((NULL != block) && (0 != __atomic_exchange_n(&block->inUse, 1, __ATOMIC_ACQUIRE))) {
+        block = block->next;
+    }
+    if (NULL == block) {
+        block = mmap(NULL, sizeof(hist_block_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == block) {
+            block = NULL;
+        } else {
+            block->inUse = 1;
+            block->next = __atomic_load_n(&histBlockList, __ATOMIC_RELAXED);
+            while (!__atomic_compare_exchange_n(&histBlockList, &block->next, block, 1,
+                                                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                /* block->next was reloaded by the failed exchange */
+            }
+        }
+    }
+    if (NULL != block) {
+        threadHist = block;
+        if (histKeyReady) {
+            pthread_setspecific(histKey, block);
+        }
+    }
+    return block;
+}
+
+/**
+ * @brief Destructor of histKey, releases the block of an exiting thread
+ *
+ * The counts stay in the block, the next thread taking it adds its own calls to them.
+ * Calls made by later destructors of the same thread are not recorded.
+ *
+ * @param arg Block registered with pthread_setspecific
+ */
+static void histRelease(void *arg) {
+    hist_block_t *block = (hist_block_t *)arg;
+    static hist_block_t histDiscard; // Absorbs the calls of the exiting thread, never reported
+
+    threadHist = &histDiscard;
+    __atomic_store_n(&block->inUse, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Finds the log-linear bucket of a duration
+ *
+ * Durations below HIST_SUB_NUM ticks have a bucket each, every larger power of two is split
+ * in HIST_SUB_NUM buckets of equal width.
+ *
+ * @param ticks Duration in ticks
+ *
+ * @return Index of the bucket
+ */
+static uint32_t histBucket(uint64_t ticks) {
+    uint32_t bucket = HIST_BUCKET_NUM - 1;
+
+    if (ticks < HIST_SUB_NUM) {
+        bucket = (uint32_t)ticks;
+    } else {
+        uint32_t log2 = 63 - __builtin_clzll(ticks);
+        if (log2 < HIST_MAX_LOG2) {
+            bucket = (log2 - HIST_SUB_BITS + 1) * HIST_SUB_NUM + ((ticks >> (log2 - HIST_SUB_BITS)) & (HIST_SUB_NUM - 1));
+        }
+    }
+    return bucket;
+}
+
+/**
+ * @brief Returns the largest duration of a bucket
+ *
+ * @param bucket Index of the bucket
+ *
+ * @return Largest duration in ticks landing in the bucket
+ */
+static uint64_t histBucketMax(uint32_t bucket) {
+    uint64_t max = bucket;
+
+    if (bucket >= HIST_SUB_NUM) {
+        uint32_t log2 = bucket / HIST_SUB_NUM + HIST_SUB_BITS - 1;
+        uint64_t width = (uint64_t)1 << (log2 - HIST_SUB_BITS);
+        max = (HIST_SUB_NUM + bucket % HIST_SUB_NUM) * width + width - 1;
+    }
+    return max;
+}
+
+/**
+ * @brief Finds the duration of the call of a given rank
+ *
+ * @param count Calls per bucket
+ * @param total Number of calls
+ * @param rank Rank of the call, 1 being the fastest
+ *
+ * @return Upper bound of the bucket holding that call, in ticks
+ */
+static uint64_t histPercentile(const uint64_t *count, uint64_t total, uint64_t rank) {
+    uint64_t seen = 0;
+    uint32_t bucket = 0;
+
+    if (rank > total) {
+        rank = total;
+    }
+    while ((bucket < HIST_BUCKET_NUM - 1) && (seen + count[bucket] < rank)) {
+        seen += count[bucket];
+        bucket++;
+    }
+    return histBucketMax(bucket);
+}
+
+/**
+ * @brief Measures the duration of a tick
+ *
+ * The time stamp counter is compared with the monotonic clock since startup; when the process
+ * is younger than 10 ms, the measure waits for that long to stay accurate.
+ *
+ * @return Nanoseconds per tick
+ */
+static double histNsPerTick(void) {
+    double nsPerTick = 1.0;
+#if defined(__x86_64__) || defined(__i386__)
+    struct timespec now;
+    double elapsedNs = 0;
+
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsedNs = (now.tv_sec - histStartTime.tv_sec) * 1e9 + (now.tv_nsec - histStartTime.tv_nsec);
+    } while (elapsedNs < 1e7);
+    nsPerTick = elapsedNs / (double)(histNow() - histStartTicks);
+#endif
+    return nsPerTick;
+}
+
+/**
+ * @brief atexit handler writing the report to the HMM_HISTOGRAM_FILE file
+ */
+static void histDumpAtExit(void) {
+    int fd = open(histFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    if (fd >= 0) {
+        hmm_histogram_dump(fd);
+        close(fd);
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef HISTOGRAM_H  // Include guard to prevent multiple inclusions
+#define HISTOGRAM_H
+
+#include <stdint.h>  // For the tick counts
+#include <stddef.h>  // For size_t
+#include <time.h>  // For clock_gettime
+
+#define HIST_MALLOC 0 // Histogram of malloc
+#define HIST_FREE 1 // Histogram of free
+#define HIST_CALLOC 2 // Histogram of calloc
+#define HIST_REALLOC 3 // Histogram of realloc
+#define HIST_OP_NUM 4 // Number of instrumented operations
+#define HIST_BAND_NUM 3 // Size bands: slab objects, heap chunks, chunks above the default mmap threshold
+#define HIST_BAND(size) (((size) <= SLAB_MAX_SIZE) ? 0 : (((size) <= MMAP_THRESHOLD_DEFAULT) ? 1 : 2)) // Band of a user size
+#define HIST_SUB_BITS 3 // Every power of two is split in 2^HIST_SUB_BITS linear buckets, 12.5% precision
+#define HIST_SUB_NUM (1 << HIST_SUB_BITS) // Buckets per power of two
+#define HIST_MAX_LOG2 40 // Durations of 2^HIST_MAX_LOG2 ticks and more land in the last bucket
+#define HIST_BUCKET_NUM ((HIST_MAX_LOG2 - HIST_SUB_BITS + 1) * HIST_SUB_NUM) // Buckets per histogram
+#define HIST_FILE_ENV "HMM_HISTOGRAM_FILE" // File the histograms are written to at exit
+
+/**
+ * @brief Latency histograms of one thread
+ *
+ * A block is mapped for every thread on its first instrumented call and only ever written by
+ * that thread. It is released, counts included, when the thread exits and reused as is by the
+ * next new thread: the report sums every block, so no count is lost and nothing is merged.
+ */
+typedef struct hist_block {
+  struct hist_block *next;                                   // Next block ever mapped
+  uint32_t inUse;                                            // Set while a thread owns the block
+  uint64_t max[HIST_OP_NUM][HIST_BAND_NUM];                  // Longest call, in ticks
+  uint64_t count[HIST_OP_NUM][HIST_BAND_NUM][HIST_BUCKET_NUM]; // Calls per duration bucket
+} hist_block_t;
+
+#ifdef HMM_HISTOGRAM
+#define HIST_INIT() histInit()
+#define HIST_START(size) uint64_t histStart = histNow(); size_t histSize = (size) // Opens the timing of a call
+#define HIST_STOP(op) histRecord((op), histSize, histNow() - histStart) // Records the call opened by HIST_START
+#else
+#define HIST_INIT() // Instrumentation compiled out, it costs nothing
+#define HIST_START(size)
+#define HIST_STOP(op)
+#endif
+
+/**
+ * @brief Reads the tick counter used to time the calls
+ *
+ * The time stamp counter on x86, a few cycles and no system call, converted to nanoseconds
+ * when the report is written. The monotonic clock in nanoseconds elsewhere.
+ *
+ * @return Current tick count
+ */
+static inline uint64_t histNow(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Prepares the histograms, called once from the library constructor
+ *
+ * Creates the key releasing the block of an exiting thread, starts the tick calibration and,
+ * when HMM_HISTOGRAM_FILE is set, writes the report to that file at exit.
+ *
+ * @return Nothing
+ */
+void histInit(void);
+
+/**
+ * @brief Records the duration of a call in the histograms of the calling thread
+ *
+ * @param op Operation (HIST_MALLOC, HIST_FREE, HIST_CALLOC or HIST_REALLOC)
+ * @param size User size of the call, selects the size band
+ * @param ticks Duration of the call in ticks
+ *
+ * @return Nothing
+ */
+void histRecord(uint32_t op, size_t size, uint64_t ticks);
+
+/**
+ * @brief Writes the latency report of every operation and size band
+ *
+ * Only available when the library is built with make HISTOGRAM=1. The counts of running
+ * threads are read as they are updated, the report is approximate while they allocate.
+ *
+ * @param fd File descriptor to write the report to
+ *
+ * @return Nothing
+ */
+void hmm_histogram_dump(int fd);
+
+#endif  // HISTOGRAM_H
@@ -4,21 +4,29 @@
  * Author: Mohamed Eslam
  */
 
+#include <errno.h> // For the error codes of the aligned allocations
+#include <stdlib.h> // For abort, on a failed check of the debug build
 #include "hmm.h" // Include header file for custom data structures and functions
 
-static node_t * findSuitableNode(node_t *ptrHead, size_t copySize, uint8_t *status);
-static node_t * splitNode(size_t copySize, node_t *freeNode, node_t **copyHeadFreeListNode);
-
-node_t *headFreeListNode = NULL; // Global pointer to the head of the free memory list
-static uint32_t* programBreak = 0; // Global pointer to the program break
+static void hmmInit(void) __attribute__((constructor));
+static void *hmmAlloc(size_t size, uint8_t zeroed);
+static void hmmFree(void *ptr);
+static void hmmFreeSized(void *ptr, size_t size);
+static void *hmmAlignedAlloc(size_t alignment, size_t size);
+static void *hmmHeapAlloc(arena_t *arena, size_t size, size_t alignment, uint8_t zeroed);
+static void hmmHeapFreeBatch(node_t **chunks, size_t num);
 
 
 /**
  * @brief Allocates memory on the heap
  *
  * This function allocates memory on the heap of size 'size' bytes.
- * It first checks the free list for a suitable block. If a suitable block is found,
- * it is removed from the list and returned to the user. Otherwise, it expands the heap
+ * Small requests (up to SLAB_MAX_SIZE) are served in O(1) by the size-class slabs, without
+ * metadata, through the per-thread cache so most of them take no lock.
+ * Requests larger than the mmap threshold get a mapping of their own, released by free, so
+ * they never pin the heap nor inflate the RSS once freed.
+ * Otherwise it takes a fit among the free blocks of the thread arena, indexed by size by the
+ * heap engine, and splits off the part it does not need. When none fits, it expands the heap
  * using sbrk and splits a newly allocated block to satisfy the request.
  *
  * @param size The size of memory to allocate in bytes
@@ -26,94 +34,21 @@ static uint32_t* programBreak = 0; // Global pointer to the program break
  * @return A pointer to the allocated memory, or NULL on failure
  */
 void *malloc(size_t size){
-    void *retAdd = NULL; // Pointer to the allocated memory, initialized to NULL
-    node_t *ptrFreeNode; // Pointer to a free memory block in the free memory list
-
-    // Adjust size to at least the size of a pointer
-    if (size < (sizeof(void *) * 2)) {
-        size = sizeof(void *) * 2;
-    }
-
-    return_status_t ret = NOK; // Return status for function calls
-    uint8_t sizeListStat = 0; // Status of size comparison with free memory blocks
-    node_t *allocNode = NULL; // Pointer to the allocated memory block
-    size = size + METADATA_SIZE; // Add metadata size to requested size
-    size = ((size + 7) / 8) * 8; //for allignment
-    uint32_t sbrkNum = 0; // Counter for the number of sbrk calls
-
-    // Traverse free list to find free node
-    node_t *freeListNode = findSuitableNode(headFreeListNode, size, &sizeListStat);
-
-    switch (sizeListStat) {
-        case EQUIV_REQ:
-            retAdd = (uint8_t *)freeListNode + METADATA_SIZE; // Return address after metadata
-            ret = removeNode(&headFreeListNode, &freeListNode); // Remove node from free list
-            break;
-        case LARGER_THAN_REQ:
-            /* To reduce external fragmentation */
-            if (freeListNode->size >= (size + 24)) {
-                allocNode = splitNode(size, freeListNode, &headFreeListNode); // Split free node
-            } else {
-                allocNode = freeListNode;
-                ret = removeNode(&headFreeListNode, &freeListNode); // Remove node from free list
-            }
-            retAdd = (uint8_t *)allocNode + METADATA_SIZE; // Return address after metadata
-            break;
-        case SMALLER_THAN_REQ:
-            ptrFreeNode = (node_t *)sbrk(SBRK_ALLOC_SIZE);
-            sbrkNum++;
-            // Check if the size of first allocated node is larger than the program break offset value
-            // If smaller, move the program break until there is enough area
-            while (size > sbrkNum * SBRK_ALLOC_SIZE) {
-                sbrk(SBRK_ALLOC_SIZE);
-                sbrkNum++;
-            }
-            programBreak = (uint32_t *)((uint8_t *)ptrFreeNode + (sbrkNum * SBRK_ALLOC_SIZE));
-            ptrFreeNode->size = sbrkNum * SBRK_ALLOC_SIZE;
-            //to reduce external fragmentation
-            if (ptrFreeNode->size >= (size + 24)) {
-                allocNode = splitNode(size, ptrFreeNode, &headFreeListNode); // Split free node
-                appendNode(freeListNode, ptrFreeNode); //add the free part node in the end of the free list
-            } else {
-                allocNode = ptrFreeNode;
-            }
-            retAdd = (uint8_t *)allocNode + METADATA_SIZE;
-            break;
-        case NULL_PTR:
-            // No free list, allocate memory using sbrk
-            ptrFreeNode = (node_t *)sbrk(SBRK_ALLOC_SIZE);
-            sbrkNum++;
-
-            // If smaller, move the program break until there is enough area
-            while (size > sbrkNum * SBRK_ALLOC_SIZE) {
-                sbrk(SBRK_ALLOC_SIZE);
-                sbrkNum++;
-            }
-
-            programBreak = (uint32_t *)((uint8_t *)ptrFreeNode + (sbrkNum * SBRK_ALLOC_SIZE));
-            ptrFreeNode->size = sbrkNum * SBRK_ALLOC_SIZE;
-            // To reduce external fragmentation
-            if (ptrFreeNode->size > (size + 24)) {
-                allocNode = splitNode(size, ptrFreeNode, &headFreeListNode);
-                headFreeListNode->next = NULL;
-                headFreeListNode->prev = NULL;
-            } else {
-                allocNode = ptrFreeNode;
-                headFreeListNode = NULL;
-            }
-            retAdd = (uint8_t *)allocNode + METADATA_SIZE; // Address returned to the user after the metadata
-
-            break;
-        default:
-            break;
-    }
+    void *ptr = NULL;
+    HIST_START(size);
 
-    return retAdd; // Return pointer to allocated memory
+    ptr = hmmAlloc(size, 0);
+    HIST_STOP(HIST_MALLOC);
+    TRACE_RECORD(TRACE_MALLOC, size, ptr, 0);
+    PROF_ALLOC(ptr, size);
+    return ptr;
 }
 /**
  * @brief Frees memory that was previously allocated by my_malloc
  *
  * This function deallocates memory pointed to by the ptr argument.
+ * The memory goes back to the arena owning it, whichever thread frees it.
+ * Small objects have no metadata, the page map gives their span and size class.
  * It finds the corresponding node in the free list and updates the free list accordingly.
  * It also attempts to merge adjacent free blocks if possible.
  * 
@@ -124,86 +59,105 @@ void *malloc(size_t size){
  * @return Nothing
  */
 void free(void *ptr) {
+    HIST_START(malloc_usable_size(ptr)); // Read before the chunk is released
+
+    TRACE_RECORD(TRACE_FREE, 0, ptr, 0); // Stamped before the block can be reused
+    hmmFree(ptr);
+    HIST_STOP(HIST_FREE);
+}
+
+/**
+ * @brief Frees a block, the body of free and of the reallocations that move a block
+ *
+ * @param ptr A pointer to the memory to be freed, or NULL
+ *
+ * @return Nothing
+ */
+static void hmmFree(void *ptr) {
     node_t *ptrFreeNode = (node_t *)(ptr - METADATA_SIZE); // Calculate pointer to metadata of memory block to free
-    uint8_t appendFlag = 1; // Flag to indicate whether the node should be appended to the free list
+    uintptr_t pageEntry = pageMapGet(ptr); // Span and class of a small object, buddy region, or 0
     return_status_t ret = NOK; // Return status for function calls
-    node_t *tempPtrNode = headFreeListNode; // Temporary pointer to traverse the free list
 
+    PROF_FREE(ptr); // A sampled block leaves the profile before its memory can be reused
     if (ptr == NULL) {
         /* Nothing to free if pointer is NULL */
+    } else if (pageEntry & PAGEMAP_SLAB_FLAG) {
+        ret = tcacheFree((node_t *)ptr, PAGEMAP_CLASS(pageEntry)); // Small objects go back to the thread cache
+    } else if (MAPPED_CHUNK(ptrFreeNode, pageEntry)) {
+        ret = mmapChunkFree(ptrFreeNode); // Large chunks are unmapped
     } else {
-        // Check if the free list isn't allocated
-        if (NULL == headFreeListNode) {
-            ptrFreeNode->prev = NULL;
-            ptrFreeNode->next = NULL;
-            headFreeListNode = ptrFreeNode; // Set the head of the free list to the freed node
-            ret = OK;
-        } else {
-            uint8_t *nextNodePtr = NULL; 
-            size_t counter = 0;
-            
-            do {
-                nextNodePtr = (uint8_t *)tempPtrNode + tempPtrNode->size;
-                if (nextNodePtr == (uint8_t *)ptrFreeNode) {
-                    // Found a free node adjacent to the one being freed, merge them
-                    tempPtrNode->size += ptrFreeNode->size;
-                    ptrFreeNode=NULL;
-                    appendFlag = 0; // No need to append the freed node, it's merged with another
-                    break;
-                }
-                else if (ptrFreeNode < (node_t *)nextNodePtr) {
-                    // Insert the freed node before the current node in the free list
-                    addNode(&ptrFreeNode, counter, &headFreeListNode); 
-                    appendFlag = 0;
-                    break;
-                }else {
-                    tempPtrNode = tempPtrNode->next;
-                }
-                counter++;
-            } while ((tempPtrNode != NULL));
-            // Append the free node to the free list if it wasn't merged with any node
-            if (appendFlag) {
-                ret = appendNode(headFreeListNode, ptrFreeNode); // Append the free node to the free list
-            }else{
-                if ((tempPtrNode->prev != NULL) && ((uint8_t *)tempPtrNode->prev + tempPtrNode->prev->size == (uint8_t *)tempPtrNode)) {
-                    mergeTwoNodes(tempPtrNode->prev, tempPtrNode); // Merge adjacent free blocks
-                    //check for further merggeng
-                    if ((tempPtrNode->prev != NULL) && ((uint8_t *)tempPtrNode->prev + tempPtrNode->prev->size == (uint8_t *)tempPtrNode)) {
-                        mergeTwoNodes(tempPtrNode->prev, tempPtrNode); // Merge adjacent free blocks
-                    }
-                }
-                if ((tempPtrNode->next != NULL) && ((uint8_t *)tempPtrNode + tempPtrNode->size == (uint8_t *)tempPtrNode->next)) {
-                    mergeTwoNodes(tempPtrNode, tempPtrNode->next); // Merge adjacent free blocks
-                    //check for further merggeng
-                    if ((tempPtrNode->next != NULL) && ((uint8_t *)tempPtrNode + tempPtrNode->size == (uint8_t *)tempPtrNode->next)) {
-                        mergeTwoNodes(tempPtrNode, tempPtrNode->next); // Merge adjacent free blocks
-                    }
-                }
-            }
-        }
-        
-        // Check if the last node in the free list can be released
-        tempPtrNode = headFreeListNode;
-        if (tempPtrNode != NULL) {
-            while (tempPtrNode->next != NULL) {
-                tempPtrNode = tempPtrNode->next; // Move to the next node in the free list
-            }
-        }
+        arena_t *arena = arenaOf(ptrFreeNode); // The chunk goes back to the arena owning it
 
-        if (tempPtrNode->size >= (size_t)MIN_FREE_SBRK) {
-            // Check if the last free memory block is adjacent to the program break
-            
-            if ((uint8_t *)tempPtrNode + tempPtrNode->size == (uint8_t *)programBreak) {
-                // Release memory from program break
-                programBreak = (uint32_t *)((uint8_t *)programBreak - (tempPtrNode->size));
-                if (tempPtrNode->prev == NULL) {
-                    headFreeListNode = NULL; // Reset head of the free list if the only node is being released
-                } else {
-                    (tempPtrNode->prev)->next = NULL; // Disconnect the last node from the free list
-                }
-                sbrk(-(tempPtrNode->size));
-            }
-        }
+        pthread_mutex_lock(&arena->lock);
+        arena->inUseBytes -= HEAP_CHUNK_BYTES(ptrFreeNode);
+        ret = heapFree(arena, ptrFreeNode);
+        pthread_mutex_unlock(&arena->lock);
+        DECAY_THREAD_CHECK(); // Started by the first heap free once wanted, outside of the lock
+    }
+}
+
+/**
+ * @brief Frees memory whose size is known to the caller (C23)
+ *
+ * The size gives the class without looking the block up in the page map: a block of up to
+ * SIZED_FREE_MAX bytes is always a slab object (malloc serves them from the slabs and realloc
+ * moves any other block shrinking that far), so it is pushed on the thread cache bin of the
+ * class of 'size'. Larger blocks, whose metadata the heap needs anyway, are freed like free()
+ * does. The library built with make DEBUG=1 checks the size against the block.
+ *
+ * @param ptr A pointer to memory from malloc, calloc or realloc, or NULL
+ * @param size The size last requested for the block
+ *
+ * @return Nothing
+ */
+void free_sized(void *ptr, size_t size) {
+    HIST_START(size);
+
+    TRACE_RECORD(TRACE_FREE, 0, ptr, 0); // Stamped before the block can be reused
+    hmmFreeSized(ptr, size);
+    HIST_STOP(HIST_FREE);
+}
+
+/**
+ * @brief Frees aligned memory whose alignment and size are known to the caller (C23)
+ *
+ * Alignments up to 16 bytes are plain allocations, freed like free_sized. Larger ones never come
+ * from the slabs, they are freed like free() does.
+ *
+ * @param ptr A pointer to memory from aligned_alloc, or NULL
+ * @param alignment The alignment requested for the block
+ * @param size The size requested for the block
+ *
+ * @return Nothing
+ */
+void free_aligned_sized(void *ptr, size_t alignment, size_t size) {
+    HIST_START(size);
+
+    TRACE_RECORD(TRACE_FREE, 0, ptr, 0);
+    if (alignment <= 16) {
+        hmmFreeSized(ptr, size);
+    } else {
+        hmmFree(ptr);
+    }
+    HIST_STOP(HIST_FREE);
+}
+
+/**
+ * @brief Frees a block of a known size, the body of the sized frees
+ *
+ * @param ptr A pointer to the memory to be freed, or NULL
+ * @param size The size last requested for the block
+ *
+ * @return Nothing
+ */
+static void hmmFreeSized(void *ptr, size_t size) {
+    if ((NULL != ptr) && (size <= SIZED_FREE_MAX)) {
+        SIZED_CHECK(ptr, size);
+        PROF_FREE(ptr);
+        tcacheFree((node_t *)ptr, SLAB_CLASS_OF(size));
+    } else {
+        SIZED_CHECK(ptr, size);
+        hmmFree(ptr);
     }
 }
 
@@ -214,6 +168,9 @@ void free(void *ptr) {
  * If successful, it initializes all bytes in the allocated block to zero. This ensures that
  * any uninitialized data is set to a known value, which can help prevent security vulnerabilities
  * and unexpected behavior.
+ * Memory known to be zero is not cleared again: a block having its own mapping comes zeroed from
+ * the kernel, and so does the heap memory that was never handed out since it came from sbrk,
+ * a new region or pages purged with MADV_DONTNEED.
  *
  * @param nmemb  The number of elements to allocate. If `nmemb` is zero, the function returns NULL.
  * @param size   The size of each element in bytes. If `size` is zero, the function returns NULL.
@@ -223,13 +180,21 @@ void free(void *ptr) {
  *          is not enough memory available to satisfy the request.
  */
 void *calloc(size_t nmemb, size_t size) {
+    void *ptr = NULL; // Pointer to the allocated memory, initialized to NULL
+    size_t total = 0; // Size of the whole array
+    HIST_START(nmemb * size);
+
     if ((nmemb == 0) || (size == 0)) {
-        return NULL; // Return NULL if either nmemb or size is zero
+        /* Nothing to allocate if either nmemb or size is zero */
+    } else if (__builtin_mul_overflow(nmemb, size, &total)) {
+        /* The array size does not fit in size_t */
     } else {
-        unsigned char *ptr = (unsigned char *)malloc(nmemb * size); // Allocate memory
-        memset(ptr, 0, (nmemb * size)); // Set memory to zero
-        return ptr; // Return pointer to allocated memory
+        ptr = hmmAlloc(total, 1);
     }
+    HIST_STOP(HIST_CALLOC);
+    TRACE_RECORD(TRACE_CALLOC, total, ptr, 0);
+    PROF_ALLOC(ptr, total);
+    return ptr; // Return pointer to allocated memory
 }
 /**
  * Resizes a previously allocated memory block.
@@ -240,8 +205,15 @@ void *calloc(size_t nmemb, size_t size) {
  * There are three main cases handled by `realloc`:
  *  - If `ptr` is NULL, it behaves exactly like `malloc(size)`.
  *  - If `size` is zero, it frees the memory pointed to by `ptr` and returns NULL.
- *  - If `size` is larger than the current allocation, it allocates a new block of memory, copies the data from the old block,
- *    and frees the old block. Otherwise, it returns the original pointer (`ptr`).
+ *  - Otherwise the block is resized in place when possible: a heap block gives its tail back when
+ *    it shrinks, and grows by absorbing the free block after it or by extending the heap end.
+ *    A block having its own mapping is resized with mremap, the kernel moves its pages without
+ *    copying them. Slab blocks, found with the page map, stay in place as long as the new size
+ *    fits their class. A heap or mapped block
+ *    shrinking to a slab size always moves to a slab object, so every block of up to
+ *    SIZED_FREE_MAX bytes is one, which free_sized relies on. Only when none of this
+ *    works, it allocates a new block of memory, copies the data from the old block, and frees
+ *    the old block. hmm_stats() reports how many reallocs were done in place or with mremap.
  *
  * @param ptr    A pointer to the previously allocated memory block, or NULL if requesting a new allocation.
  * @param size   The new size of the memory block in bytes. If `size` is zero, the function frees the memory pointed to by `ptr`.
@@ -251,106 +223,514 @@ void *calloc(size_t nmemb, size_t size) {
  */
 void *realloc(void *ptr, size_t size) {
     void *newptr = NULL; // Initialize new pointer to NULL
+    node_t *chunk = (node_t *)(ptr - METADATA_SIZE); // Metadata of the block to resize, unless it is a slab object or buddy chunk
+    HIST_START(size);
 
     if (NULL == ptr) {
-        newptr = malloc(size); // Allocate memory if ptr is NULL
+        newptr = hmmAlloc(size, 0); // Allocate memory if ptr is NULL
     } else if (0 == size) {
-        free(ptr); // Free memory if size is zero
-    } else {
-        if (size <= ((node_t *)(ptr - 8))->size - 8) {
-            newptr = ptr; // Return ptr if size is smaller or equal than the current allocated size
+        hmmFree(ptr); // Free memory if size is zero
+    } else if (size <= MAX_REQUEST_SIZE) {
+        size_t chunkSize = REQUEST_TO_CHUNK(size);
+        uintptr_t pageEntry = pageMapGet(ptr);
+        uint8_t sampled = PROF_RESIZE_START(ptr); // Read before the resize rewrites or unmaps the metadata
+
+        STATS_ADD(reallocNum, 1);
+        if (pageEntry & PAGEMAP_SLAB_FLAG) {
+            if (size <= slabClassSize[PAGEMAP_CLASS(pageEntry)]) {
+                newptr = ptr; // Still fits in its slab object
+            }
+        } else if (size <= SLAB_MAX_SIZE) {
+            /* Moves to a slab object, small blocks are never heap or mapped chunks */
+        } else if (MAPPED_CHUNK(chunk, pageEntry)) {
+            node_t *newChunk = mmapChunkResize(chunk, chunkSize); // The kernel moves pages, not bytes
+
+            if (NULL != newChunk) {
+                newptr = (uint8_t *)newChunk + METADATA_SIZE;
+                STATS_ADD(reallocRemapNum, 1);
+            } else if (chunkSize <= CHUNK_SIZE(chunk)) {
+                newptr = ptr; // Still fits in its mapping
+            }
         } else {
-            newptr = malloc(size); // Allocate new memory block
-            if(NULL!=newptr){
-                memcpy(newptr, ptr, ((node_t *)(ptr - 8))->size - 8); // Copy data to new memory block
-                free(ptr); // Free the old memory block
+            arena_t *arena = arenaOf(chunk);
+            size_t oldSize = HEAP_CHUNK_BYTES(chunk);
+
+            pthread_mutex_lock(&arena->lock);
+            if (OK == heapResize(arena, chunk, chunkSize)) {
+                arena->inUseBytes += HEAP_CHUNK_BYTES(chunk) - oldSize; // Wraps around to a subtraction on a shrink
+                newptr = ptr;
+            }
+            pthread_mutex_unlock(&arena->lock);
+        }
+        PROF_RESIZE_END(sampled, ptr, newptr); // The resized block is sampled again as a new allocation
+
+        if (ptr == newptr) {
+            STATS_ADD(reallocInPlaceNum, 1);
+        } else if (NULL == newptr) {
+            size_t copySize = malloc_usable_size(ptr); // Usable size of the old block
+
+            newptr = hmmAlloc(size, 0); // Allocate new memory block
+            if (NULL != newptr) {
+                memcpy(newptr, ptr, (copySize < size) ? copySize : size); // Copy data to new memory block
+                hmmFree(ptr); // Free the old memory block, which retires it from the profile
             }
         }
     }
+    HIST_STOP(HIST_REALLOC);
+    TRACE_RECORD(TRACE_REALLOC, size, newptr, (uintptr_t)ptr);
+    PROF_ALLOC(newptr, size);
     return newptr; // Return pointer to reallocated memory block
 }
 
 /**
- * @brief Finds a node in the list that has sufficient size to accommodate a requested size.
- *
- * This function takes the head of the list (`ptrHead`), a desired size (`copySize`), pointers to output status (`status`) and index (`index`),
- * and searches through the list.
- * The `status` pointer (output) can be used to indicate:
- *   - EQUIV_REQ (1): Node size is exactly equal to the requested size.
- *   - LARGER_THAN_REQ (2): Node size is larger than the requested size.
- *   - SMALLER_THAN_REQ (3): Node size is smaller than the requested size.
- * The `index` pointer (output) holds the index of the found node in the list (0-based).
- *
- * @param ptrHead Pointer to the head node of the doubly linked list.
- * @param copySize Size to be accommodated in the found node.
- * @param status Output pointer to receive a status code (EQUIV_REQ, LARGER_THAN_REQ, SMALLER_THAN_REQ).
- * 
- * @return node_t* Pointer to the found node, or NULL if no suitable node is found.
+ * @brief Allocates memory aligned on a power of two
+ *
+ * POSIX flavour of the aligned allocations: the alignment must be a power of two and a multiple
+ * of sizeof(void *). The block can be freed and reallocated like any other one.
+ *
+ * @param memptr Receives the pointer to the allocated memory, left untouched on failure
+ * @param alignment Alignment of the memory in bytes
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return 0 on success, EINVAL if the alignment is not valid, ENOMEM if there is not enough memory
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    int ret = 0;
+    void *ptr = NULL;
+
+    if ((0 == alignment) || (0 != (alignment & (alignment - 1))) || (0 != (alignment % sizeof(void *)))) {
+        ret = EINVAL;
+    } else {
+        ptr = hmmAlignedAlloc(alignment, size);
+        if (NULL == ptr) {
+            ret = ENOMEM;
+        } else {
+            *memptr = ptr;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Allocates memory aligned on a power of two (C11)
+ *
+ * @param alignment Alignment of the memory in bytes, a power of two
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return A pointer to the allocated memory, or NULL on failure (errno is EINVAL when the
+ *         alignment is not a power of two)
+ */
+void *aligned_alloc(size_t alignment, size_t size) {
+    void *ptr = NULL;
+
+    if ((0 == alignment) || (0 != (alignment & (alignment - 1)))) {
+        errno = EINVAL;
+    } else {
+        ptr = hmmAlignedAlloc(alignment, size);
+    }
+    return ptr;
+}
+
+/**
+ * @brief Allocates aligned memory (obsolete interface)
+ *
+ * Like glibc, an alignment that is not a power of two is rounded up to the next one.
+ *
+ * @param alignment Alignment of the memory in bytes
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+void *memalign(size_t alignment, size_t size) {
+    void *ptr = NULL;
+
+    if (alignment > MAX_REQUEST_SIZE) {
+        errno = EINVAL;
+    } else {
+        if (0 != (alignment & (alignment - 1))) {
+            alignment = (size_t)1 << (64 - __builtin_clzl(alignment)); // Next power of two
+        }
+        ptr = hmmAlignedAlloc(alignment, size);
+    }
+    return ptr;
+}
+
+/**
+ * @brief Allocates memory aligned on a page (obsolete interface)
+ *
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+void *valloc(size_t size) {
+    return hmmAlignedAlloc(getpagesize(), size);
+}
+
+/**
+ * @brief Allocates whole pages, aligned on a page (obsolete interface)
+ *
+ * @param size The size of memory to allocate in bytes, rounded up to a multiple of the page size
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
  */
-static node_t * findSuitableNode(node_t *ptrHead, size_t copySize, uint8_t *status) {
-    node_t *retAdd = NULL;
-    uint8_t statusFlag = 1;
-    // Check if pointers are NULL
-    if ((NULL == ptrHead) || (status == NULL) ) {
-        retAdd = NULL;
-        *status = NULL_PTR; // Set status to NULL_PTR if any of the pointers are NULL.
+void *pvalloc(size_t size) {
+    void *ptr = NULL;
+    size_t pageSize = getpagesize();
+
+    if (size <= MAX_REQUEST_SIZE) {
+        size = (0 == size) ? pageSize : ((size + pageSize - 1) & ~(pageSize - 1));
+        ptr = hmmAlignedAlloc(pageSize, size);
+    }
+    return ptr;
+}
+
+/**
+ * @brief Returns the number of bytes usable in an allocated block
+ *
+ * It is at least the requested size: chunk sizes are rounded up to 16 bytes, to the size class
+ * of a slab, to a page for a mapped block or to a power of two for the buddy engine.
+ * The size of a slab object comes from the class of its span in the page map.
+ *
+ * @param ptr A pointer to the allocated memory, or NULL
+ *
+ * @return The usable size in bytes, 0 for NULL
+ */
+size_t malloc_usable_size(void *ptr) {
+    size_t usableSize = 0;
+    node_t *chunk = (node_t *)((uint8_t *)ptr - METADATA_SIZE);
+    uintptr_t pageEntry = pageMapGet(ptr);
+
+    if (pageEntry & PAGEMAP_SLAB_FLAG) {
+        usableSize = slabClassSize[PAGEMAP_CLASS(pageEntry)];
+    } else if (NULL == ptr) {
+        /* Nothing is usable in NULL */
+    } else if (MAPPED_CHUNK(chunk, pageEntry)) {
+        usableSize = CHUNK_SIZE(chunk) - METADATA_SIZE;
     } else {
-        uint32_t tempIndex = 0;
-        node_t *tempNode = ptrHead;
-        
-        // Iterate through the list to find a suitable node.
-        do {
-            if (tempNode->size == copySize) {
-                *status = EQUIV_REQ; // Set status to EQUIV_REQ if node size is equal to copySize.
-                retAdd = tempNode;
-                statusFlag = 0;
+        usableSize = HEAP_USABLE_SIZE(chunk);
+    }
+    return usableSize;
+}
+
+/**
+ * @brief Allocates several blocks of the same size in one call
+ *
+ * The blocks are carved in one pass instead of 'num' calls of malloc: small ones are taken from
+ * the thread cache bin then from one refill of the slabs (tcacheAllocBatch), medium ones from a
+ * single fit of the arena heap split into consecutive chunks (heapAllocBatch), both under one
+ * acquisition of the arena lock. Blocks above the mmap threshold each get their own mapping.
+ * Every block is recorded and sampled like a malloc, it is freed with free() or hmm_free_batch().
+ *
+ * @param size The size of every block in bytes
+ * @param num Number of blocks wanted
+ * @param ptrs Receives the pointers to the blocks, 'num' entries
+ *
+ * @return Number of blocks allocated (the first entries of 'ptrs'), less than 'num' only when
+ *         the memory ran out
+ */
+size_t hmm_malloc_batch(size_t size, size_t num, void **ptrs) {
+    size_t allocNum = 0;
+    size_t chunkSize = (size > MAX_REQUEST_SIZE) ? 0 : REQUEST_TO_CHUNK(size);
+
+    if ((0 == chunkSize) || (NULL == ptrs)) {
+        /* Nothing can be allocated */
+    } else if (size <= SLAB_MAX_SIZE) {
+        allocNum = tcacheAllocBatch(SLAB_CLASS_OF(size), ptrs, num); // Slab objects are their user areas
+    } else if (chunkSize > mmapChunkThreshold()) {
+        while (allocNum < num) {
+            void *ptr = hmmAlloc(size, 0); // One mapping per block
+            if (NULL == ptr) {
                 break;
-            } else if (tempNode->size > (copySize+16)) {
-                *status = LARGER_THAN_REQ; // Set status to LARGER_THAN_REQ if node size is larger than copySize.
-                retAdd = tempNode;
-                statusFlag = 0;
+            }
+            ptrs[allocNum++] = ptr;
+        }
+    } else {
+        arena_t *arena = arenaGet();
+
+        pthread_mutex_lock(&arena->lock);
+        allocNum = heapAllocBatch(arena, chunkSize, num, ptrs);
+        for (size_t i = 0; i < allocNum; i++) {
+            arena->inUseBytes += HEAP_CHUNK_BYTES((node_t *)((uint8_t *)ptrs[i] - METADATA_SIZE));
+        }
+        pthread_mutex_unlock(&arena->lock);
+        while (allocNum < num) {
+            void *ptr = hmmHeapAlloc(arena, chunkSize, 0, 0); // Falls back to the main arena
+            if (NULL == ptr) {
                 break;
-            } else {
-                // Node size is smaller than copySize, continue searching.
             }
-            retAdd = tempNode;
-            tempNode = tempNode->next;
-            tempIndex++;
-        } while (NULL != tempNode);
+            ptrs[allocNum++] = ptr;
+        }
+    }
+    for (size_t i = 0; i < allocNum; i++) {
+        TRACE_RECORD(TRACE_MALLOC, size, ptrs[i], 0);
+        PROF_ALLOC(ptrs[i], size);
+    }
+    return allocNum;
+}
+
+/**
+ * @brief Frees several blocks in one call
+ *
+ * Slab blocks go to the thread cache and mapped blocks are unmapped as free() does. The heap
+ * blocks are gathered by BATCH_FREE_NUM and handed to hmmHeapFreeBatch: each arena is locked
+ * once per batch instead of once per block, and the engine frees them together (heapFreeBatch),
+ * the boundary-tag heap merging the blocks next to each other in one sweep.
+ *
+ * @param ptrs Pointers to the blocks to free, the array itself is not changed
+ * @param num Number of entries in 'ptrs'
+ *
+ * @return Nothing
+ */
+void hmm_free_batch(void **ptrs, size_t num) {
+    node_t *heapChunks[BATCH_FREE_NUM]; // Heap chunks waiting to be sorted and freed
+    size_t heapNum = 0;
+
+    for (size_t i = 0; i < num; i++) {
+        void *ptr = ptrs[i];
+        node_t *chunk = (node_t *)((uint8_t *)ptr - METADATA_SIZE);
+        uintptr_t pageEntry = pageMapGet(ptr);
+
+        TRACE_RECORD(TRACE_FREE, 0, ptr, 0);
+        PROF_FREE(ptr);
+        if (NULL == ptr) {
+            /* Nothing to free if pointer is NULL */
+        } else if (pageEntry & PAGEMAP_SLAB_FLAG) {
+            tcacheFree((node_t *)ptr, PAGEMAP_CLASS(pageEntry));
+        } else if (MAPPED_CHUNK(chunk, pageEntry)) {
+            mmapChunkFree(chunk);
+        } else {
+            heapChunks[heapNum++] = chunk;
+            if (BATCH_FREE_NUM == heapNum) {
+                hmmHeapFreeBatch(heapChunks, heapNum);
+                heapNum = 0;
+            }
+        }
+    }
+    if (0 != heapNum) {
+        hmmHeapFreeBatch(heapChunks, heapNum);
+    }
+}
+
+/**
+ * @brief Gives the free heap memory of every arena back to the OS (glibc interface)
+ *
+ * The free memory at the top of each heap is released down to 'pad' bytes and the whole pages
+ * of every other free chunk are purged with MADV_DONTNEED; the chunks stay free and their pages
+ * come back zeroed when they are used again. Slab spans and thread caches are not touched.
+ *
+ * @param pad Free bytes kept at the top of each heap
+ *
+ * @return 1 if some memory was given back, 0 otherwise
+ */
+int malloc_trim(size_t pad) {
+    size_t released = 0;
+
+    for (uint32_t i = 0; i < ARENA_MAX_NUM; i++) {
+        pthread_mutex_lock(&arenaTable[i].lock);
+        released += heapTrim(&arenaTable[i], pad);
+        pthread_mutex_unlock(&arenaTable[i].lock);
+    }
+    return (0 != released) ? 1 : 0;
+}
+
+/**
+ * @brief Library constructor
+ *
+ * Reads the HMM_* settings, creates the key draining the thread caches and makes fork() take every arena lock,
+ * so a child never inherits one locked by a thread that does not exist anymore. The prepare
+ * handlers of fork run in the reverse order of their registration, so the profiler registers
+ * after the arenas and its lock is taken first, in the order of profSample and realloc.
+ * In the instrumented build it also prepares the latency histograms, and it starts recording
+ * the calls when HMM_TRACE_FILE is set and installs the dump signal of the heap profiler
+ * (HMM_PROF_SIGNAL). The background purging thread is only started by the first heap free,
+ * never from here.
+ */
+static void hmmInit(void) {
+    tuneInit();
+    tcacheInit();
+    HIST_INIT();
+    traceInit();
+    decayInit();
+    pthread_atfork(arenaForkPrepare, arenaForkParent, arenaForkChild);
+    profInit(); // Registered last so fork takes profLock before the arena locks, like realloc does
+}
+
+/**
+ * @brief Allocates a chunk for malloc and calloc
+ *
+ * Small requests (up to SLAB_MAX_SIZE) come from the slabs through the thread cache, their
+ * objects have no metadata. Requests larger than the mmap threshold get a mapping of their own,
+ * the others a fit in the heap of the thread arena (or of the main arena when it does not fit
+ * in a region).
+ * With 'zeroed', only the bytes that are not known to be zero are cleared: a new mapping is
+ * never touched and the heap engine skips the memory that did not change since it came from
+ * the OS.
+ *
+ * @param size The size of memory to allocate in bytes
+ * @param zeroed Non-zero when the user area must read as zero
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+static void *hmmAlloc(size_t size, uint8_t zeroed) {
+    void *retAdd = NULL; // Pointer to the allocated memory, initialized to NULL
+    node_t *allocNode = NULL; // Pointer to the allocated memory block
+
+    if (size > MAX_REQUEST_SIZE) {
+        /* The chunk size would overflow, the request fails */
+    } else if (size <= SLAB_MAX_SIZE) {
+        // Small objects come from their size-class slab and never touch the free list
+        uint32_t classIndex = SLAB_CLASS_OF(size);
+
+        retAdd = tcacheAlloc(classIndex);
+        if ((NULL != retAdd) && zeroed) {
+            memset(retAdd, 0, slabClassSize[classIndex]); // Slab objects are recycled
+        }
+    } else {
+        arena_t *arena = arenaGet();
+
+        size = REQUEST_TO_CHUNK(size); // Add metadata size, user areas are 16-byte aligned
+        if (size > mmapChunkThreshold()) {
+            // Large chunks get a mapping of their own, the heap is only used if mmap fails.
+            // A new mapping is always zero, it never needs clearing
+            allocNode = mmapChunkAlloc(size, 0);
+            if (NULL != allocNode) {
+                retAdd = (uint8_t *)allocNode + METADATA_SIZE;
+            }
+        }
+        if (NULL == retAdd) {
+            retAdd = hmmHeapAlloc(arena, size, 0, zeroed);
+        }
+    }
+
+    return retAdd;
+}
 
-        if (statusFlag) {
-            *status = SMALLER_THAN_REQ; // Set status to SMALLER_THAN_REQ if no suitable node is found.
+/**
+ * @brief Allocates a chunk whose user area is aligned, for the aligned allocation family
+ *
+ * Every user area is 16-byte aligned, so smaller alignments are plain allocations. The others
+ * never come from the slabs: a large chunk gets a mapping of its own (the pages before and after
+ * it are unmapped), any other one is carved from the arena heap, which takes the memory before
+ * the aligned chunk back instead of wasting it.
+ *
+ * @param alignment Alignment of the user area, a power of two
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+static void *hmmAlignedAlloc(size_t alignment, size_t size) {
+    void *retAdd = NULL;
+    node_t *allocNode = NULL;
+
+    if (alignment <= 16) {
+        retAdd = hmmAlloc(size, 0);
+    } else if ((size <= MAX_REQUEST_SIZE) && (alignment <= MAX_REQUEST_SIZE - size)) {
+        arena_t *arena = arenaGet();
+        size_t chunkSize = REQUEST_TO_CHUNK(size);
+
+        if (chunkSize > mmapChunkThreshold()) {
+            allocNode = mmapChunkAlloc(chunkSize, alignment);
+            if (NULL != allocNode) {
+                retAdd = (uint8_t *)allocNode + METADATA_SIZE;
+            }
+        }
+        if (NULL == retAdd) {
+            retAdd = hmmHeapAlloc(arena, chunkSize, alignment, 0);
         }
     }
+    TRACE_RECORD(TRACE_MEMALIGN, size, retAdd, alignment);
+    PROF_ALLOC(retAdd, size);
     return retAdd;
 }
+
 /**
- * @brief Splits a node in the doubly linked list into two nodes based on a specified size.
+ * @brief Allocates a chunk from the heap of an arena under its lock
  *
- * This function takes the size to be copied (`copySize`), pointers to output allocated and free nodes (`allocNode` and `freeNode`),
- * and a pointer to potentially update the head of the free list (`copyHeadFreeListNode`).
- * It splits the original node into two nodes: one with the requested size and another with the remaining memory.
- * The function updates pointers and assigns the appropriate nodes to the output pointers.
+ * A request that does not fit in a region of a non-main arena is retried on the main arena,
+ * whose heap can still grow. The chunk is counted in the bytes in use of its arena.
  *
- * @param copySize Size of the data to be copied into the allocated node.
- * @param freeNode Output pointer to receive the free node (remaining memory).
- * @param copyHeadFreeListNode Pointer to potentially update the head of the free list (optional).
- * 
- * @return void (no return value).
+ * @param arena Arena of the calling thread
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param alignment Alignment of the user area, a power of two (16 or less for none)
+ * @param zeroed Non-zero when the user area must read as zero, only for unaligned chunks
+ *
+ * @return A pointer to the user area of the chunk, or NULL on failure
  */
-static node_t * splitNode(size_t copySize, node_t *freeNode, node_t **copyHeadFreeListNode) {
-    // Check if freeNode is NULL
-    node_t *allocNode=NULL;
-    if (NULL == freeNode) {
-        allocNode = NULL; // If freeNode is NULL, set allocNode to NULL.
+static void *hmmHeapAlloc(arena_t *arena, size_t size, size_t alignment, uint8_t zeroed) {
+    void *retAdd = NULL;
+
+    pthread_mutex_lock(&arena->lock);
+    if (alignment > 16) {
+        retAdd = heapAllocAligned(arena, size, alignment);
     } else {
-        size_t tempOldNodeSize=freeNode->size;
-        allocNode=(node_t *)((uint8_t *)freeNode+(tempOldNodeSize-copySize));
-        freeNode->size=tempOldNodeSize-copySize;
-        allocNode->size=copySize;
-        if(NULL==(*copyHeadFreeListNode)){
-            (*copyHeadFreeListNode)=freeNode;
+        retAdd = heapAlloc(arena, size, zeroed);
+    }
+    if (NULL != retAdd) {
+        arena->inUseBytes += HEAP_CHUNK_BYTES((node_t *)((uint8_t *)retAdd - METADATA_SIZE));
+    }
+    pthread_mutex_unlock(&arena->lock);
+
+    if ((NULL == retAdd) && (arena != &arenaTable[0])) {
+        retAdd = hmmHeapAlloc(&arenaTable[0], size, alignment, zeroed);
+    }
+    return retAdd;
+}
+
+/**
+ * @brief Returns heap chunks gathered by hmm_free_batch to their arenas
+ *
+ * The chunks of the arena of the first chunk are moved to the front, handed to the engine under
+ * a single acquisition of its lock, then the same is done with the rest. A batch usually holds
+ * the chunks of one or two arenas, so this costs a pass or two over the chunks.
+ *
+ * @param chunks Heap chunks to free, reordered in place
+ * @param num Number of chunks
+ */
+static void hmmHeapFreeBatch(node_t **chunks, size_t num) {
+    size_t start = 0;
+
+    while (start < num) {
+        arena_t *arena = arenaOf(chunks[start]);
+        size_t freedBytes = HEAP_CHUNK_BYTES(chunks[start]);
+        size_t end = start + 1; // chunks[start..end) belong to 'arena'
+
+        for (size_t i = end; i < num; i++) {
+            if (arenaOf(chunks[i]) == arena) {
+                node_t *chunk = chunks[i];
+                chunks[i] = chunks[end];
+                chunks[end++] = chunk;
+                freedBytes += HEAP_CHUNK_BYTES(chunk);
+            }
+        }
+        pthread_mutex_lock(&arena->lock);
+        arena->inUseBytes -= freedBytes;
+        heapFreeBatch(arena, &chunks[start], end - start);
+        pthread_mutex_unlock(&arena->lock);
+        start = end;
+    }
+    DECAY_THREAD_CHECK(); // Outside of the locks, like the heap frees of free()
+}
+
+#ifdef HMM_DEBUG
+/**
+ * @brief Checks the size given to a sized free against the metadata of the block, debug builds only
+ *
+ * The block must be able to hold the size, and be a slab object when the size is a slab one,
+ * its class being what the sized free puts in the thread cache instead of the page map entry.
+ * A mismatch is reported on stderr and the process aborts, the heap would be corrupted otherwise.
+ *
+ * @param ptr A pointer to the memory to be freed, or NULL
+ * @param size The size given by the caller
+ *
+ * @return Nothing
+ */
+void hmmSizedCheck(void *ptr, size_t size) {
+    if (NULL != ptr) {
+        if ((malloc_usable_size(ptr) < size) || ((size <= SIZED_FREE_MAX) && (0 == (pageMapGet(ptr) & PAGEMAP_SLAB_FLAG)))) {
+            static const char message[] = "hmm: sized free with a size that does not match the block\n";
+            write(STDERR_FILENO, message, sizeof(message) - 1);
+            abort();
         }
     }
-    return allocNode;
 }
+#endif
@@ -2,20 +2,58 @@
 #define HMM_H
 
 #include <unistd.h>  // For sbrk (if used)
+#include <pthread.h>  // For the lock of the shared backend
 #include "./../DoubleLinkedList/DoubleLinkedList.h"  // Include header for doubly linked list implementation
+#include "slab.h"  // Size-class slabs for the small allocations
+#include "pagemap.h"  // Span of the small objects, which have no metadata
+#include "tcache.h"  // Per-thread caches in front of the slabs
+#include "arena.h"  // Arenas owning the heaps, each with its own lock
+#include "heap.h"  // Heap engine of the medium/large chunks
+#include "stats.h"  // Counters reported by hmm_stats
+#include "mmapchunk.h"  // Large chunks mapped on their own
+#include "histogram.h"  // Latency histograms of the instrumented build
+#include "trace.h"  // Recorder of the calls, for the offline replay
+#include "tunables.h"  // Settings changed with HMM_* variables and mallopt
+#include "profile.h"  // Sampling heap profiler
 #include <string.h>
 
 #define METADATA_SIZE 8 // Size of metadata stored with each allocated memory block
-#define SBRK_ALLOC_SIZE (4*1024*1024) // Size of memory to request from OS using sbrk
-#define MIN_FREE_SBRK (3*1024*1024) // Minimum size of free memory to release using sbrk
+#define SBRK_ALLOC_SIZE (4*1024*1024) // Default step of the heap growth (HMM_GROW_SIZE, M_TOP_PAD)
+#define MIN_FREE_SBRK (3*1024*1024) // Default size of free top memory released to the OS (HMM_TRIM_THRESHOLD, M_TRIM_THRESHOLD)
+#define CHUNK_FLAGS_MASK 0xF // Low bits of the chunk metadata used as flags (sizes are multiple of 16)
+#define PREV_INUSE_FLAG 0x2 // The physically previous heap chunk is in use, so it has no footer
+#define HEAP_MIN_CHUNK FREE_INDEX_MIN_CHUNK // Smallest free heap chunk: metadata, index links and footer
+#define CHUNK_SIZE(node) ((node)->size & ~(size_t)CHUNK_FLAGS_MASK) // Chunk size without the flags
+#define NEXT_CHUNK(node) ((node_t *)((uint8_t *)(node) + CHUNK_SIZE(node))) // Physically next chunk
+#define CHUNK_FOOTER(node) (*(size_t *)((uint8_t *)(node) + CHUNK_SIZE(node) - sizeof(size_t))) // Boundary tag of a free chunk
+#define PREV_CHUNK(node) ((node_t *)((uint8_t *)(node) - *((size_t *)(node) - 1))) // Previous chunk, only valid when it is free
+#define MAX_REQUEST_SIZE (PTRDIFF_MAX - 2*1024*1024) // Larger requests fail, their chunk size would overflow
+#if defined(HMM_ENGINE_BUDDY)
+#define REQUEST_TO_CHUNK(req) ((((((req) < 2 * sizeof(void *)) ? 2 * sizeof(void *) : (req)) + 15) & ~(size_t)15) + 2 * METADATA_SIZE) // Chunk size of a request: a buddy block holds the size minus 2 * METADATA_SIZE, so a 2^k request takes a 2^k block
+#else
+#define REQUEST_TO_CHUNK(req) (((((req) < 2 * sizeof(void *)) ? 2 * sizeof(void *) : (req)) + METADATA_SIZE + 15) & ~(size_t)15) // Chunk size of a request, at least a pointer pair of user area
+#endif
+#define MAPPED_CHUNK(chunk, entry) ((0 == ((entry) & PAGEMAP_HEAP_FLAG)) && ((chunk)->size & MMAPPED_CHUNK_FLAG)) // A non-slab chunk has its own mapping, buddy chunks have no metadata to read
+#define SIZED_FREE_MAX SLAB_MAX_SIZE // Sizes up to this one are slab objects, the sized frees cache them without a page map lookup
+#define BATCH_FREE_NUM 256 // Heap chunks sorted and freed together by hmm_free_batch
+#define HEAP_FENCE(end) ((node_t *)((((uintptr_t)(end) - 16) & ~(uintptr_t)15) + 8)) // Fence chunk of a heap ending at 'end'
+
+#ifdef HMM_DEBUG
+#define SIZED_CHECK(ptr, size) hmmSizedCheck((ptr), (size)) // Aborts when a sized free was given a size its block cannot hold
+#else
+#define SIZED_CHECK(ptr, size) // Checks compiled out, the sized frees trust their caller
+#endif
 
 
 /**
  * @brief Allocates memory on the heap
  *
  * This function allocates memory on the heap of size 'size' bytes.
- * It first checks the free list for a suitable block. If a suitable block is found,
- * it is removed from the list and returned to the user. Otherwise, it expands the heap
+ * Small requests (up to SLAB_MAX_SIZE) are served in O(1) by the size-class slabs, without
+ * metadata, through the per-thread cache so most of them take no lock.
+ * Requests larger than the mmap threshold get a mapping of their own, released by free.
+ * Otherwise it takes a fit among the free blocks of the thread arena, indexed by size by the
+ * heap engine, and splits off the part it does not need. When none fits, it expands the heap
  * using sbrk and splits a newly allocated block to satisfy the request.
  *
  * @param size The size of memory to allocate in bytes
@@ -39,6 +77,30 @@ void *malloc(size_t size);
  */
 void free(void *ptr);
 
+/**
+ * @brief Frees memory whose size is known to the caller (C23)
+ *
+ * A block of up to SIZED_FREE_MAX bytes is a slab object, it goes to the thread cache bin of the
+ * class of 'size' without a page map lookup. Larger blocks are freed like free() does.
+ *
+ * @param ptr A pointer to memory from malloc, calloc or realloc, or NULL
+ * @param size The size last requested for the block
+ *
+ * @return Nothing
+ */
+void free_sized(void *ptr, size_t size);
+
+/**
+ * @brief Frees aligned memory whose alignment and size are known to the caller (C23)
+ *
+ * @param ptr A pointer to memory from aligned_alloc, or NULL
+ * @param alignment The alignment requested for the block
+ * @param size The size requested for the block
+ *
+ * @return Nothing
+ */
+void free_aligned_sized(void *ptr, size_t alignment, size_t size);
+
 /**
  * Resizes a previously allocated memory block.
  *
@@ -48,8 +110,10 @@ void free(void *ptr);
  * There are three main cases handled by `realloc`:
  *  - If `ptr` is NULL, it behaves exactly like `malloc(size)`.
  *  - If `size` is zero, it frees the memory pointed to by `ptr` and returns NULL.
- *  - If `size` is larger than the current allocation, it allocates a new block of memory, copies the data from the old block,
- *    and frees the old block. Otherwise, it returns the original pointer (`ptr`).
+ *  - Otherwise the block is resized in place when possible (shrinking gives the tail back, growing
+ *    absorbs the free block after it or extends the heap end), a mapped block is resized with mremap
+ *    without copying its pages. Only when it cannot, it allocates a new block
+ *    of memory, copies the data from the old block, and frees the old block.
  *
  * @param ptr    A pointer to the previously allocated memory block, or NULL if requesting a new allocation.
  * @param size   The new size of the memory block in bytes. If `size` is zero, the function frees the memory pointed to by `ptr`.
@@ -75,4 +139,116 @@ void *realloc(void *ptr, size_t size);
  */
 void *calloc(size_t nmemb, size_t size);
 
+/**
+ * @brief Allocates memory aligned on a power of two
+ *
+ * The alignment must be a power of two and a multiple of sizeof(void *). Aligned blocks are
+ * carved from the heap like the others, the memory skipped before them goes back to the free
+ * blocks. They are freed and reallocated like any other block.
+ *
+ * @param memptr Receives the pointer to the allocated memory, left untouched on failure
+ * @param alignment Alignment of the memory in bytes
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return 0 on success, EINVAL if the alignment is not valid, ENOMEM if there is not enough memory
+ */
+int posix_memalign(void **memptr, size_t alignment, size_t size);
+
+/**
+ * @brief Allocates memory aligned on a power of two (C11)
+ *
+ * @param alignment Alignment of the memory in bytes, a power of two
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+void *aligned_alloc(size_t alignment, size_t size);
+
+/**
+ * @brief Allocates aligned memory, the alignment is rounded up to a power of two (obsolete interface)
+ *
+ * @param alignment Alignment of the memory in bytes
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+void *memalign(size_t alignment, size_t size);
+
+/**
+ * @brief Allocates memory aligned on a page (obsolete interface)
+ *
+ * @param size The size of memory to allocate in bytes
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+void *valloc(size_t size);
+
+/**
+ * @brief Allocates whole pages, aligned on a page (obsolete interface)
+ *
+ * @param size The size of memory to allocate in bytes, rounded up to a multiple of the page size
+ *
+ * @return A pointer to the allocated memory, or NULL on failure
+ */
+void *pvalloc(size_t size);
+
+/**
+ * @brief Returns the number of bytes usable in an allocated block, at least the requested size
+ *
+ * @param ptr A pointer to the allocated memory, or NULL
+ *
+ * @return The usable size in bytes, 0 for NULL
+ */
+size_t malloc_usable_size(void *ptr);
+
+/**
+ * @brief Allocates several blocks of the same size in one call
+ *
+ * The blocks are carved in one pass: small ones from the thread cache then one refill of the
+ * slabs, the others from a single fit of the arena heap split into consecutive blocks, all under
+ * one acquisition of the arena lock. Every block is freed with free() or hmm_free_batch().
+ *
+ * @param size The size of every block in bytes
+ * @param num Number of blocks wanted
+ * @param ptrs Receives the pointers to the blocks, 'num' entries
+ *
+ * @return Number of blocks allocated (the first entries of 'ptrs'), less than 'num' only when
+ *         the memory ran out
+ */
+size_t hmm_malloc_batch(size_t size, size_t num, void **ptrs);
+
+/**
+ * @brief Frees several blocks in one call
+ *
+ * Each arena is locked once per batch and the heap blocks next to each other are merged in one
+ * sweep. NULL entries are skipped.
+ *
+ * @param ptrs Pointers to the blocks to free, the array itself is not changed
+ * @param num Number of entries in 'ptrs'
+ *
+ * @return Nothing
+ */
+void hmm_free_batch(void **ptrs, size_t num);
+
+/**
+ * @brief Gives the free heap memory of every arena back to the OS (glibc interface)
+ *
+ * @param pad Free bytes kept at the top of each heap
+ *
+ * @return 1 if some memory was given back, 0 otherwise
+ */
+int malloc_trim(size_t pad);
+
+#ifdef HMM_DEBUG
+/**
+ * @brief Checks the size given to a sized free against the metadata of the block, debug builds only
+ *
+ * @param ptr A pointer to the memory to be freed, or NULL
+ * @param size The size given by the caller
+ *
+ * @return Nothing
+ */
+void hmmSizedCheck(void *ptr, size_t size);
+#endif
+
 #endif  // HMM_H
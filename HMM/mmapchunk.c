@@ -0,0 +1,170 @@
+/*
+ * File: mmapchunk.c
+ * Description: large chunks mapped on their own, so they go back to the OS as soon as they are freed.
+ * Author: Mohamed Eslam
+ */
+
+#define _GNU_SOURCE // For mremap
+#include <sys/mman.h> // For mmap, mremap and munmap
+#include "hmm.h"
+
+#define MMAP_PAGE_UP(size) (((size) + getpagesize() - 1) & ~((size_t)getpagesize() - 1)) // Rounds up to a page
+#define MMAP_MAP_SIZE(offset, size) MMAP_PAGE_UP((offset) + (size) + sizeof(size_t)) // Mapping of a chunk at 'offset'
+#define MMAP_CHUNK_IN(mapSize, offset) (((mapSize) - (offset) - sizeof(size_t)) & ~(size_t)15) // Largest chunk fitting a mapping
+
+static size_t mmapThreshold = MMAP_THRESHOLD_DEFAULT; // Chunk size from which malloc maps a chunk on its own
+static uint8_t mmapThresholdFixed = 0; // Set once the threshold was fixed, it does not adapt anymore
+
+
+/**
+ * @brief Maps a chunk on its own
+ *
+ * The mapping starts with a word holding the offset of the chunk, the chunk metadata follows,
+ * so the user area is page aligned plus 16. The chunk size is a multiple of 16 ending 8 to 23
+ * bytes before the end of the mapping, so the mapping size is the chunk end rounded up to a page.
+ * An aligned chunk is placed at the first aligned user area of a mapping larger by 'alignment',
+ * the whole pages before its offset word and after its end are unmapped at once.
+ *
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param alignment Alignment of the user area, a power of two (16 or less for none)
+ *
+ * @return Pointer to the chunk (not to the user area), or NULL if mmap failed
+ */
+node_t *mmapChunkAlloc(size_t size, size_t alignment) {
+    node_t *chunk = NULL;
+    size_t slack = (alignment > 16) ? alignment : 0; // Room to move the user area to the alignment
+    size_t mapSize = MMAP_MAP_SIZE(sizeof(size_t), size + slack);
+    uint8_t *map = NULL;
+
+    if (mapSize > size + slack) { // Rejects the sizes wrapping around
+        map = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED != map) {
+            size_t offset = sizeof(size_t);
+
+            if (0 != slack) {
+                uint8_t *user = (uint8_t *)(((uintptr_t)map + 2 * sizeof(size_t) + alignment - 1) & ~((uintptr_t)alignment - 1));
+                size_t headSize = (user - 2 * sizeof(size_t) - map) & ~((size_t)getpagesize() - 1); // Pages before the offset word
+                size_t usedSize = 0;
+
+                if (0 != headSize) {
+                    munmap(map, headSize);
+                    map += headSize;
+                    mapSize -= headSize;
+                }
+                offset = user - METADATA_SIZE - map;
+                usedSize = MMAP_MAP_SIZE(offset, size);
+                if (usedSize < mapSize) {
+                    munmap(map + usedSize, mapSize - usedSize);
+                    mapSize = usedSize;
+                }
+            }
+            chunk = (node_t *)(map + offset);
+            MMAP_CHUNK_OFFSET(chunk) = offset;
+            chunk->size = MMAP_CHUNK_IN(mapSize, offset) | MMAPPED_CHUNK_FLAG;
+            STATS_ADD(mmapNum, 1);
+            STATS_ADD(mmapBytes, mapSize);
+        }
+    }
+    return chunk;
+}
+
+/**
+ * @brief Resizes a chunk allocated by mmapChunkAlloc with mremap
+ *
+ * The kernel moves the page table entries when the mapping cannot grow where it is, so the
+ * data is never copied: the cost is proportional to the number of pages, not of bytes.
+ * A shrink unmaps the pages at the end. The chunk keeps its offset in the mapping.
+ *
+ * @param chunk Pointer to the chunk metadata
+ * @param size New size of the chunk in bytes (metadata included, multiple of 16)
+ *
+ * @return Pointer to the chunk at its possibly new address, or NULL if mremap failed,
+ *         the chunk is then left untouched
+ */
+node_t *mmapChunkResize(node_t *chunk, size_t size) {
+    node_t *newChunk = NULL;
+
+    if (NULL != chunk) {
+        size_t offset = MMAP_CHUNK_OFFSET(chunk);
+        size_t mapSize = MMAP_PAGE_UP(offset + CHUNK_SIZE(chunk));
+        size_t newMapSize = MMAP_MAP_SIZE(offset, size);
+
+        if (newMapSize == mapSize) {
+            newChunk = chunk; // Same pages
+        } else if (newMapSize > size) { // Rejects the sizes wrapping around
+            uint8_t *map = mremap((uint8_t *)chunk - offset, mapSize, newMapSize, MREMAP_MAYMOVE);
+            if (MAP_FAILED != map) {
+                newChunk = (node_t *)(map + offset);
+                STATS_ADD(mmapBytes, newMapSize - mapSize); // Wraps around to a subtraction on a shrink
+            }
+        }
+        if (NULL != newChunk) {
+            newChunk->size = MMAP_CHUNK_IN(newMapSize, offset) | MMAPPED_CHUNK_FLAG;
+        }
+    }
+    return newChunk;
+}
+
+/**
+ * @brief Unmaps a chunk allocated by mmapChunkAlloc
+ *
+ * Like the glibc dynamic threshold: a freed chunk larger than the threshold shows the program
+ * allocates and frees buffers of that size repeatedly, so the threshold is raised to its size
+ * (up to MMAP_THRESHOLD_MAX) and the next ones are recycled by the heap instead of paying
+ * a mmap/munmap pair each time. A threshold fixed with mmapChunkSetThreshold never moves.
+ *
+ * @param chunk Pointer to the chunk metadata
+ *
+ * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ */
+return_status_t mmapChunkFree(node_t *chunk) {
+    return_status_t ret = OK;
+
+    if (NULL == chunk) {
+        ret = NULLPTR;
+    } else {
+        size_t offset = MMAP_CHUNK_OFFSET(chunk);
+        size_t mapSize = MMAP_PAGE_UP(offset + CHUNK_SIZE(chunk));
+
+        if ((!__atomic_load_n(&mmapThresholdFixed, __ATOMIC_RELAXED)) &&
+            (CHUNK_SIZE(chunk) > __atomic_load_n(&mmapThreshold, __ATOMIC_RELAXED)) &&
+            (CHUNK_SIZE(chunk) <= MMAP_THRESHOLD_MAX)) {
+            __atomic_store_n(&mmapThreshold, CHUNK_SIZE(chunk), __ATOMIC_RELAXED);
+        }
+        if (0 != munmap((uint8_t *)chunk - offset, mapSize)) {
+            ret = NOK;
+        } else {
+            STATS_SUB(mmapNum, 1);
+            STATS_SUB(mmapBytes, mapSize);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns the chunk size from which malloc maps a chunk on its own
+ *
+ * @return The current threshold in bytes
+ */
+size_t mmapChunkThreshold(void) {
+    return __atomic_load_n(&mmapThreshold, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Fixes the threshold, which stops adapting to the freed chunks
+ *
+ * @param threshold New threshold in bytes, at most MMAP_THRESHOLD_MAX
+ *
+ * @return return_status_t indicating success (OK) or error (NOK).
+ */
+return_status_t mmapChunkSetThreshold(size_t threshold) {
+    return_status_t ret = OK;
+
+    if (threshold > MMAP_THRESHOLD_MAX) {
+        ret = NOK;
+    } else {
+        __atomic_store_n(&mmapThreshold, threshold, __ATOMIC_RELAXED);
+        __atomic_store_n(&mmapThresholdFixed, 1, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
@@ -0,0 +1,64 @@
+#ifndef MMAPCHUNK_H  // Include guard to prevent multiple inclusions
+#define MMAPCHUNK_H
+
+#include "./../DoubleLinkedList/DoubleLinkedList.h"  // node_t is the chunk metadata
+
+#define MMAPPED_CHUNK_FLAG 0x4 // Set in the chunk metadata of every chunk having its own mapping
+#define MMAP_THRESHOLD_DEFAULT (128*1024) // Initial chunk size from which malloc maps a chunk on its own
+#define MMAP_THRESHOLD_MAX (32*1024*1024) // Largest value the dynamic threshold can reach
+#define MMAP_CHUNK_OFFSET(chunk) (*((size_t *)(chunk) - 1)) // Distance from the mapping start to the chunk
+
+/**
+ * @brief Maps a chunk on its own
+ *
+ * The mapping starts with a word holding the offset of the chunk, the chunk metadata follows,
+ * so the user area is page aligned plus 16, unless it is aligned further (the offset is then
+ * larger). The chunk metadata holds the size of the chunk tagged with MMAPPED_CHUNK_FLAG.
+ *
+ * @param size Size of the chunk in bytes (metadata included, multiple of 16)
+ * @param alignment Alignment of the user area, a power of two (16 or less for none)
+ *
+ * @return Pointer to the chunk (not to the user area), or NULL if mmap failed
+ */
+node_t *mmapChunkAlloc(size_t size, size_t alignment);
+
+/**
+ * @brief Resizes a chunk allocated by mmapChunkAlloc with mremap, without copying its data
+ *
+ * @param chunk Pointer to the chunk metadata
+ * @param size New size of the chunk in bytes (metadata included, multiple of 16)
+ *
+ * @return Pointer to the chunk at its possibly new address, or NULL if mremap failed,
+ *         the chunk is then left untouched
+ */
+node_t *mmapChunkResize(node_t *chunk, size_t size);
+
+/**
+ * @brief Unmaps a chunk allocated by mmapChunkAlloc
+ *
+ * Freeing a chunk larger than the current threshold raises the threshold to its size
+ * (up to MMAP_THRESHOLD_MAX), unless the threshold was fixed with mmapChunkSetThreshold.
+ *
+ * @param chunk Pointer to the chunk metadata
+ *
+ * @return return_status_t indicating success (OK) or error (NOK, NULLPTR).
+ */
+return_status_t mmapChunkFree(node_t *chunk);
+
+/**
+ * @brief Returns the chunk size from which malloc maps a chunk on its own
+ *
+ * @return The current threshold in bytes
+ */
+size_t mmapChunkThreshold(void);
+
+/**
+ * @brief Fixes the threshold, which stops adapting to the freed chunks
+ *
+ * @param threshold New threshold in bytes, at most MMAP_THRESHOLD_MAX
+ *
+ * @return return_status_t indicating success (OK) or error (NOK).
+ */
+return_status_t mmapChunkSetThreshold(size_t threshold);
+
+#endif  // MMAPCHUNK_H
@@ -0,0 +1,113 @@
+/*
+ * File: pagemap.c
+ * Description: radix tree mapping the span sized pages of the address space to their slab span
+ *              and size class, or to their buddy heap region, so the small objects and the
+ *              buddy chunks need no metadata of their own.
+ * Author: Mohamed Eslam
+ */
+
+#include <sys/mman.h> // For mmap and munmap
+#include "hmm.h"
+
+static uintptr_t *pageMapLeaf(uintptr_t page);
+
+// Two levels cover the 48-bit address space: the root lives in .bss and only the pages of it
+// that are used get committed, a leaf (512 KiB) is mapped the first time a span lands in its
+// 4 GiB and only its pages holding entries are touched
+uintptr_t *pageMapRoot[PAGEMAP_ROOT_NUM];
+
+
+/**
+ * @brief Records a new slab span in the map
+ *
+ * The entry is the span address tagged with PAGEMAP_SLAB_FLAG and the class in its low bits,
+ * which the alignment of the span leaves at zero, so free reads both with a single load.
+ *
+ * @param span SLAB_SPAN_SIZE aligned span
+ * @param classIndex Size class of its objects
+ *
+ * @return 1 on success, 0 if the leaf covering the span could not be mapped
+ */
+uint8_t pageMapSet(slab_span_t *span, uint32_t classIndex) {
+    uintptr_t page = (uintptr_t)span >> PAGEMAP_SHIFT;
+    uintptr_t *leaf = pageMapLeaf(page);
+
+    if (NULL != leaf) {
+        __atomic_store_n(&leaf[page & (PAGEMAP_LEAF_NUM - 1)], (uintptr_t)span | PAGEMAP_SLAB_FLAG | classIndex, __ATOMIC_RELAXED);
+    }
+    return (NULL != leaf) ? 1 : 0;
+}
+
+/**
+ * @brief Records a new heap region whose chunks have no metadata, for the buddy engine
+ *
+ * Every page of the region gets the region address tagged with PAGEMAP_HEAP_FLAG, so free tells
+ * a buddy chunk from a mapped one without reading in front of it. An aligned region never
+ * straddles two leaves.
+ *
+ * @param region Region start, aligned on its size
+ * @param size Size of the region, a multiple of SLAB_SPAN_SIZE within one leaf
+ *
+ * @return 1 on success, 0 if the leaf covering the region could not be mapped
+ */
+uint8_t pageMapSetRegion(void *region, size_t size) {
+    uintptr_t page = (uintptr_t)region >> PAGEMAP_SHIFT;
+    uintptr_t *leaf = pageMapLeaf(page);
+    uintptr_t entry = (uintptr_t)region | PAGEMAP_HEAP_FLAG;
+
+    if (NULL != leaf) {
+        for (size_t i = 0; i < (size >> PAGEMAP_SHIFT); i++) {
+            __atomic_store_n(&leaf[(page + i) & (PAGEMAP_LEAF_NUM - 1)], entry, __ATOMIC_RELAXED);
+        }
+    }
+    return (NULL != leaf) ? 1 : 0;
+}
+
+/**
+ * @brief Removes a span from the map before it is unmapped
+ *
+ * The leaf stays mapped, a later span of the same 4 GiB reuses it.
+ *
+ * @param span Span recorded with pageMapSet
+ *
+ * @return Nothing
+ */
+void pageMapClear(slab_span_t *span) {
+    uintptr_t page = (uintptr_t)span >> PAGEMAP_SHIFT;
+    uintptr_t *leaf = pageMapRoot[page >> PAGEMAP_LEAF_BITS];
+
+    if (NULL != leaf) {
+        __atomic_store_n(&leaf[page & (PAGEMAP_LEAF_NUM - 1)], 0, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Returns the leaf covering a page, mapping it the first time
+ *
+ * Arenas create spans and regions under their own locks, so two of them may map the same leaf at once:
+ * the first one published wins and the other one is unmapped.
+ *
+ * @param page Page number, below PAGEMAP_ROOT_NUM << PAGEMAP_LEAF_BITS
+ *
+ * @return The leaf, or NULL if it could not be mapped
+ */
+static uintptr_t *pageMapLeaf(uintptr_t page) {
+    uintptr_t **slot = &pageMapRoot[page >> PAGEMAP_LEAF_BITS];
+    uintptr_t *leaf = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+    if ((NULL == leaf) && (page < (PAGEMAP_ROOT_NUM << PAGEMAP_LEAF_BITS))) {
+        uintptr_t *expected = NULL;
+        void *map = mmap(NULL, PAGEMAP_LEAF_NUM * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if (MAP_FAILED == map) {
+            /* The span or region cannot be recorded, it is not used */
+        } else if (__atomic_compare_exchange_n(slot, &expected, (uintptr_t *)map, 0, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+            leaf = map;
+        } else {
+            munmap(map, PAGEMAP_LEAF_NUM * sizeof(uintptr_t));
+            leaf = expected; // Mapped by another arena meanwhile
+        }
+    }
+    return leaf;
+}
@@ -0,0 +1,78 @@
+#ifndef PAGEMAP_H  // Include guard to prevent multiple inclusions
+#define PAGEMAP_H
+
+#include <stdint.h>  // For the entries
+#include <stddef.h>  // For NULL
+#include "slab.h"  // The map describes the slab spans
+
+#define PAGEMAP_SHIFT 16 // log2(SLAB_SPAN_SIZE), the map has one entry per span sized page of the address space
+#define PAGEMAP_ADDRESS_BITS 48 // User address space covered, higher addresses are never slab objects or heap regions
+#define PAGEMAP_LEAF_BITS 16 // Page number bits resolved by a leaf, a leaf covers 4 GiB
+#define PAGEMAP_ROOT_BITS (PAGEMAP_ADDRESS_BITS - PAGEMAP_SHIFT - PAGEMAP_LEAF_BITS) // Page number bits resolved by the root
+#define PAGEMAP_LEAF_NUM ((size_t)1 << PAGEMAP_LEAF_BITS) // Entries of a leaf
+#define PAGEMAP_ROOT_NUM ((size_t)1 << PAGEMAP_ROOT_BITS) // Leaves of the root
+#define PAGEMAP_CLASS_MASK 0xFF // Low bits of a span entry holding its size class
+#define PAGEMAP_SLAB_FLAG 0x100 // Set in the entries of a slab span
+#define PAGEMAP_HEAP_FLAG 0x200 // Set in the entries of a heap region whose chunks have no metadata (buddy engine)
+#define PAGEMAP_SPAN(entry) ((slab_span_t *)((entry) & ~((uintptr_t)SLAB_SPAN_SIZE - 1))) // Span of a PAGEMAP_SLAB_FLAG entry
+#define PAGEMAP_CLASS(entry) ((uint32_t)((entry) & PAGEMAP_CLASS_MASK)) // Size class of a PAGEMAP_SLAB_FLAG entry
+
+extern uintptr_t *pageMapRoot[PAGEMAP_ROOT_NUM]; // Leaves of the map, mapped when a span first lands in their range
+
+/**
+ * @brief Looks up the slab span or heap region holding an address
+ *
+ * Two dependent loads and no lock: an entry only changes while its span has no object handed
+ * out, so a pointer to a live object always reads the entry of its span. Heap regions stay
+ * recorded as long as the process lives.
+ *
+ * @param ptr Any address, NULL included
+ *
+ * @return The span address tagged with PAGEMAP_SLAB_FLAG and its size class (PAGEMAP_SPAN,
+ *         PAGEMAP_CLASS), the region address tagged with PAGEMAP_HEAP_FLAG, or 0 when the
+ *         address is in neither
+ */
+static inline uintptr_t pageMapGet(const void *ptr) {
+    uintptr_t page = (uintptr_t)ptr >> PAGEMAP_SHIFT;
+    uintptr_t entry = 0;
+
+    if (page < (PAGEMAP_ROOT_NUM << PAGEMAP_LEAF_BITS)) {
+        uintptr_t *leaf = __atomic_load_n(&pageMapRoot[page >> PAGEMAP_LEAF_BITS], __ATOMIC_ACQUIRE);
+
+        if (NULL != leaf) {
+            entry = __atomic_load_n(&leaf[page & (PAGEMAP_LEAF_NUM - 1)], __ATOMIC_RELAXED);
+        }
+    }
+    return entry;
+}
+
+/**
+ * @brief Records a new slab span in the map
+ *
+ * @param span SLAB_SPAN_SIZE aligned span
+ * @param classIndex Size class of its objects
+ *
+ * @return 1 on success, 0 if the leaf covering the span could not be mapped
+ */
+uint8_t pageMapSet(slab_span_t *span, uint32_t classIndex);
+
+/**
+ * @brief Records a new heap region whose chunks have no metadata, for the buddy engine
+ *
+ * @param region Region start, aligned on its size
+ * @param size Size of the region, a multiple of SLAB_SPAN_SIZE within one leaf
+ *
+ * @return 1 on success, 0 if the leaf covering the region could not be mapped
+ */
+uint8_t pageMapSetRegion(void *region, size_t size);
+
+/**
+ * @brief Removes a span from the map before it is unmapped
+ *
+ * @param span Span recorded with pageMapSet
+ *
+ * @return Nothing
+ */
+void pageMapClear(slab_span_t *span);
+
+#endif  // PAGEMAP_H
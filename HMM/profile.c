@@ -0,0 +1,622 @@
+/*
+ * File: profile.c
+ * Description: sampling heap profiler, keeping the allocation stack of about one block per
+ *              HMM_PROF_SAMPLE bytes and the bytes each stack still holds, dumped for pprof.
+ * Author: Mohamed Eslam
+ */
+
+#include <errno.h> // Saved by the signal handler
+#include <execinfo.h> // For backtrace
+#include <fcntl.h> // For open
+#include <signal.h> // For the dump signal
+#include <stdlib.h> // For getenv, strtoul and atexit
+#include <sys/mman.h> // For mmap
+#include "hmm.h"
+
+#define PROF_SKIP_NUM 3 // Frames of profSample, profAlloc and the allocation function at the top of every backtrace
+#define PROF_LIVE_LOAD (PROF_LIVE_NUM / 4 * 3) // Live blocks above which new samples are dropped, keeps the probes short
+#if defined(HMM_ENGINE_BUDDY)
+#define PROF_HEAP_FLAGS(chunk) BUDDY_MAP(BUDDY_BLOCK_OF(chunk)) // Flags of an allocated heap chunk, its order map entry
+#define PROF_HEAP_SAMPLED BUDDY_MAP_SAMPLED // Sampled flag of a heap chunk
+#else
+#define PROF_HEAP_FLAGS(chunk) ((chunk)->size) // Flags of an allocated heap chunk, in its metadata
+#define PROF_HEAP_SAMPLED PROF_SAMPLED_FLAG // Sampled flag of a heap chunk
+#endif
+
+static void profSample(void *ptr, size_t size) __attribute__((noinline));
+static int64_t profNextInterval(void);
+static uint8_t profFlagged(void *ptr);
+static void profSetFlag(void *ptr, uint8_t set);
+static uint8_t profTablesMap(void);
+static uint32_t profStackGet(const uintptr_t *frame, uint32_t depth);
+static uint32_t profLiveHash(uintptr_t ptr);
+static uint8_t profLiveInsert(uintptr_t ptr, size_t size, uint32_t stack);
+static uint8_t profLiveRemove(uintptr_t ptr, prof_live_t *live);
+static void profUnlock(void);
+static void profWrite(int fd);
+static void profDumpFile(void);
+static void profSignal(int sig);
+static void profProcessExit(void);
+static void profForkPrepare(void);
+static void profForkParent(void);
+static void profForkChild(void);
+
+static pthread_mutex_t profLock = PTHREAD_MUTEX_INITIALIZER; // Protects the tables, only taken for sampled blocks
+static prof_stack_t *profStacks = NULL; // Stack table, mapped with the first sample
+static prof_live_t *profLive = NULL; // Live sampled blocks, open addressing on the user pointer
+static uint32_t profLiveCount = 0; // Entries of profLive
+static const char *profFilePrefix = PROF_FILE_DEFAULT; // Prefix of the profile files
+static uint32_t profDumpNum = 0; // Profile files written, numbers the next one
+static volatile sig_atomic_t profDumpPending = 0; // Set by the signal when the tables were locked
+uint8_t profSampledAny = 0; // Set by the first sample, a block may be flagged as sampled from then on
+static __thread int64_t profCountdown __attribute__((tls_model("initial-exec"))); // Bytes left before the next sample of the thread
+static __thread uint64_t profRandom __attribute__((tls_model("initial-exec"))); // xorshift state of the thread, 0 before its first allocation
+static __thread uint8_t profBusy __attribute__((tls_model("initial-exec"))); // Set while the thread samples, its own allocations are not sampled
+
+
+/**
+ * @brief Reads HMM_PROF_FILE and HMM_PROF_SIGNAL, called once from the library constructor
+ *
+ * HMM_PROF_FILE is the prefix of the profile files, one is written at exit when it is set.
+ * HMM_PROF_SIGNAL installs a handler writing a profile each time that signal is received.
+ * Profiling itself is turned on with HMM_PROF_SAMPLE or mallopt(M_HMM_PROF_SAMPLE).
+ *
+ * @return Nothing
+ */
+void profInit(void) {
+    const char *file = getenv(PROF_FILE_ENV);
+    const char *signalText = getenv(PROF_SIGNAL_ENV);
+
+    if ((NULL != file) && ('\0' != file[0])) {
+        profFilePrefix = file;
+        atexit(profProcessExit);
+    }
+    if (NULL != signalText) {
+        unsigned long sig = strtoul(signalText, NULL, 0);
+
+        if ((sig > 0) && (sig < NSIG)) {
+            struct sigaction action;
+
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = profSignal;
+            action.sa_flags = SA_RESTART;
+            sigemptyset(&action.sa_mask);
+            sigaction((int)sig, &action, NULL);
+        }
+    }
+    pthread_atfork(profForkPrepare, profForkParent, profForkChild);
+}
+
+/**
+ * @brief Counts an allocation against the sampling interval of the calling thread and samples it when due
+ *
+ * Every thread draws the bytes until its next sample from an exponential distribution of mean
+ * HMM_PROF_SAMPLE, so the samples form a Poisson process over the allocated bytes: a block of
+ * n bytes is sampled with a probability of about n / HMM_PROF_SAMPLE and blocks larger than the
+ * interval nearly always are. Between two samples an allocation costs a subtraction.
+ *
+ * @param ptr Block returned by the allocation, NULL when it failed
+ * @param size Requested size
+ *
+ * @return Nothing
+ */
+void profAlloc(void *ptr, size_t size) {
+    if ((NULL != ptr) && !profBusy) {
+        if (0 == profRandom) {
+            profRandom = ((uintptr_t)&profRandom ^ decayNow()) | 1; // Threads draw different intervals
+            profCountdown = profNextInterval();
+        }
+        profCountdown -= (int64_t)size;
+        if (profCountdown < 0) {
+            profSample(ptr, size); // Not a tail call, so profAlloc keeps its frame
+            profCountdown = profNextInterval();
+        }
+    }
+}
+
+/**
+ * @brief Retires a block from the bytes live of its stack and clears its flag, when it was sampled
+ *
+ * Only the flag is read for a block that was not sampled, the tables are locked for the others.
+ *
+ * @param ptr Block about to be freed
+ *
+ * @return Nothing
+ */
+void profFree(void *ptr) {
+    prof_live_t live;
+
+    if (__builtin_expect(profFlagged(ptr), 0)) {
+        profSetFlag(ptr, 0);
+        pthread_mutex_lock(&profLock);
+        if (profLiveRemove((uintptr_t)ptr, &live)) {
+            profStacks[live.stack].liveNum--;
+            profStacks[live.stack].liveBytes -= live.size;
+        }
+        profUnlock();
+    }
+}
+
+/**
+ * @brief Locks the profile before a sampled block is resized in place or with mremap
+ *
+ * The block keeps its profile entry until the resize is known to succeed, and a block moved by
+ * mremap leaves the profile before another allocation can be sampled at its old address.
+ * The lock is taken before the arena lock, like in profSample.
+ *
+ * @param ptr Block about to be resized
+ *
+ * @return 1 when the block was sampled and the profile is locked, 0 otherwise
+ */
+uint8_t profResizeStart(void *ptr) {
+    uint8_t sampled = profFlagged(ptr);
+
+    if (__builtin_expect(sampled, 0)) {
+        pthread_mutex_lock(&profLock);
+    }
+    return sampled;
+}
+
+/**
+ * @brief Retires a sampled block when its resize succeeded, and unlocks the profile
+ *
+ * A block moved by mremap is only looked up by its old address, its new metadata carries no flag.
+ *
+ * @param ptr Block that was resized
+ * @param newptr Resized block, ptr when it stayed in place, NULL when the resize failed
+ *
+ * @return Nothing
+ */
+void profResizeEnd(void *ptr, void *newptr) {
+    prof_live_t live;
+
+    if (NULL != newptr) {
+        if (ptr == newptr) {
+            profSetFlag(ptr, 0);
+        }
+        if (profLiveRemove((uintptr_t)ptr, &live)) {
+            profStacks[live.stack].liveNum--;
+            profStacks[live.stack].liveBytes -= live.size;
+        }
+    }
+    profUnlock();
+}
+
+/**
+ * @brief Writes the heap profile in the legacy text format of pprof (heap_v2)
+ *
+ * Every stack lists its live sampled blocks and bytes, then all those it ever sampled.
+ * pprof scales them by the sampling interval of the header and symbolizes the frames with the
+ * MAPPED_LIBRARIES section, e.g. pprof --text ./program hmm.1234.0.heap.
+ * Nothing is written while profiling was never on.
+ *
+ * @param fd File descriptor to write the profile to
+ *
+ * @return Nothing
+ */
+void hmm_prof_dump(int fd) {
+    pthread_mutex_lock(&profLock);
+    profWrite(fd);
+    profUnlock();
+}
+
+/**
+ * @brief Records the stack of a sampled block and flags its chunk
+ *
+ * backtrace() may allocate the first time it runs (it loads the unwinder), those allocations
+ * are not sampled. When a table is full the sample is dropped and the block is not flagged.
+ *
+ * @param ptr Sampled block
+ * @param size Requested size
+ */
+static void profSample(void *ptr, size_t size) {
+    void *frame[PROF_DEPTH_MAX + PROF_SKIP_NUM];
+    int depth = 0;
+    uint8_t sampled = 0;
+
+    profBusy = 1;
+    depth = backtrace(frame, PROF_DEPTH_MAX + PROF_SKIP_NUM);
+    pthread_mutex_lock(&profLock);
+    if ((depth > PROF_SKIP_NUM) && profTablesMap()) {
+        uint32_t stack = profStackGet((const uintptr_t *)&frame[PROF_SKIP_NUM], (uint32_t)(depth - PROF_SKIP_NUM));
+
+        if ((UINT32_MAX != stack) && profLiveInsert((uintptr_t)ptr, size, stack)) {
+            profStacks[stack].liveNum++;
+            profStacks[stack].liveBytes += size;
+            profStacks[stack].allocNum++;
+            profStacks[stack].allocBytes += size;
+            sampled = 1;
+        }
+    }
+    profUnlock();
+    if (sampled) {
+        __atomic_store_n(&profSampledAny, 1, __ATOMIC_RELAXED); // Published to a freeing thread with the block
+        profSetFlag(ptr, 1);
+    }
+    profBusy = 0;
+}
+
+/**
+ * @brief Draws the bytes until the next sample of the calling thread
+ *
+ * -ln(U) * HMM_PROF_SAMPLE for U uniform in (0, 1], from a xorshift64* generator. The logarithm
+ * is a short series, libm is not needed and a few digits are plenty for a sampling interval:
+ * with r = m * 2^k and m in [1, 2), ln(r) = k ln(2) + 2 (t + t^3/3 + t^5/5 + t^7/7), t = (m-1)/(m+1).
+ *
+ * @return Number of bytes
+ */
+static int64_t profNextInterval(void) {
+    uint64_t r = 0;
+    uint32_t k = 0;
+    double m = 0, t = 0, t2 = 0, lnR = 0;
+
+    profRandom ^= profRandom >> 12;
+    profRandom ^= profRandom << 25;
+    profRandom ^= profRandom >> 27;
+    r = ((profRandom * 0x2545F4914F6CDD1DULL) >> 11) + 1; // 1 to 2^53, U = r / 2^53
+    k = 63 - __builtin_clzll(r);
+    m = (double)r / (double)((uint64_t)1 << k);
+    t = (m - 1) / (m + 1);
+    t2 = t * t;
+    lnR = k * 0.6931471805599453 + 2 * t * (1 + t2 * (1.0 / 3 + t2 * (1.0 / 5 + t2 / 7)));
+    return (int64_t)((53 * 0.6931471805599453 - lnR) * (double)TUNE_GET(profSample));
+}
+
+/**
+ * @brief Tells whether a block is flagged as sampled
+ *
+ * @param ptr Allocated block
+ *
+ * @return Non-zero when the block was sampled
+ */
+static uint8_t profFlagged(void *ptr) {
+    uintptr_t entry = pageMapGet(ptr);
+    node_t *chunk = (node_t *)((uint8_t *)ptr - METADATA_SIZE);
+    uint8_t flagged = 0;
+
+    if (entry & PAGEMAP_SLAB_FLAG) {
+        slab_span_t *span = PAGEMAP_SPAN(entry);
+        size_t bit = ((uintptr_t)ptr - (uintptr_t)span) >> 4;
+
+        flagged = (__atomic_load_n(&span->sampled[bit >> 6], __ATOMIC_RELAXED) >> (bit & 63)) & 1;
+    } else if (MAPPED_CHUNK(chunk, entry)) {
+        flagged = (0 != (chunk->size & PROF_SAMPLED_FLAG));
+    } else {
+        flagged = (0 != (PROF_HEAP_FLAGS(chunk) & PROF_HEAP_SAMPLED));
+    }
+    return flagged;
+}
+
+/**
+ * @brief Sets or clears the sampled flag of an allocated block
+ *
+ * Slab objects have no metadata, their flag is a bit of the bitmap of their span, shared with
+ * the other objects of the span and so changed atomically. Other blocks keep PROF_SAMPLED_FLAG in
+ * their metadata, or BUDDY_MAP_SAMPLED in their order map entry for the buddy engine. That of a
+ * heap chunk is also written by the frees of its neighbours (PREV_INUSE_FLAG) under the arena
+ * lock, so it is changed under that lock too. Mapped chunks have no such neighbour.
+ *
+ * @param ptr Allocated block
+ * @param set Non-zero to set the flag, zero to clear it
+ */
+static void profSetFlag(void *ptr, uint8_t set) {
+    uintptr_t entry = pageMapGet(ptr);
+
+    if (entry & PAGEMAP_SLAB_FLAG) {
+        slab_span_t *span = PAGEMAP_SPAN(entry);
+        size_t bit = ((uintptr_t)ptr - (uintptr_t)span) >> 4;
+
+        if (set) {
+            __atomic_fetch_or(&span->sampled[bit >> 6], (uint64_t)1 << (bit & 63), __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_and(&span->sampled[bit >> 6], ~((uint64_t)1 << (bit & 63)), __ATOMIC_RELAXED);
+        }
+    } else {
+        node_t *chunk = (node_t *)((uint8_t *)ptr - METADATA_SIZE);
+
+        if (MAPPED_CHUNK(chunk, entry)) {
+            if (set) {
+                chunk->size |= PROF_SAMPLED_FLAG;
+            } else {
+                chunk->size &= ~(size_t)PROF_SAMPLED_FLAG;
+            }
+        } else {
+            arena_t *arena = arenaOf(chunk);
+
+            pthread_mutex_lock(&arena->lock);
+            if (set) {
+                PROF_HEAP_FLAGS(chunk) |= PROF_HEAP_SAMPLED;
+            } else {
+                PROF_HEAP_FLAGS(chunk) &= ~PROF_HEAP_SAMPLED;
+            }
+            pthread_mutex_unlock(&arena->lock);
+        }
+    }
+}
+
+/**
+ * @brief Maps the stack and live block tables the first time they are needed
+ *
+ * @note The caller must hold profLock
+ *
+ * @return 1 when the tables are mapped, 0 if mmap failed
+ */
+static uint8_t profTablesMap(void) {
+    if (NULL == profStacks) {
+        void *stacks = mmap(NULL, PROF_STACK_NUM * sizeof(prof_stack_t), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        void *live = mmap(NULL, PROF_LIVE_NUM * sizeof(prof_live_t), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+        if ((MAP_FAILED != stacks) && (MAP_FAILED != live)) {
+            profLive = live;
+            profStacks = stacks;
+        } else {
+            if (MAP_FAILED != stacks) {
+                munmap(stacks, PROF_STACK_NUM * sizeof(prof_stack_t));
+            }
+            if (MAP_FAILED != live) {
+                munmap(live, PROF_LIVE_NUM * sizeof(prof_live_t));
+            }
+        }
+    }
+    return (NULL != profStacks) ? 1 : 0;
+}
+
+/**
+ * @brief Finds the slot of a stack, adding it when it is new
+ *
+ * @note The caller must hold profLock
+ *
+ * @param frame Return addresses, innermost first
+ * @param depth Number of frames, at most PROF_DEPTH_MAX
+ *
+ * @return Slot of the stack, UINT32_MAX when the table is full
+ */
+static uint32_t profStackGet(const uintptr_t *frame, uint32_t depth) {
+    uint32_t ret = UINT32_MAX;
+    uint64_t hash = 0xCBF29CE484222325ULL; // FNV-1a over the frame words
+
+    for (uint32_t i = 0; i < depth; i++) {
+        hash = (hash ^ frame[i]) * 0x100000001B3ULL;
+    }
+    hash |= 1; // 0 marks a free slot
+    for (uint32_t probe = 0; (probe < PROF_STACK_NUM) && (UINT32_MAX == ret); probe++) {
+        uint32_t i = (uint32_t)(hash + probe) & (PROF_STACK_NUM - 1);
+        prof_stack_t *stack = &profStacks[i];
+
+        if (0 == stack->hash) {
+            stack->hash = hash;
+            stack->depth = depth;
+            memcpy(stack->frame, frame, depth * sizeof(uintptr_t));
+            ret = i;
+        } else if ((hash == stack->hash) && (depth == stack->depth) &&
+                   (0 == memcmp(stack->frame, frame, depth * sizeof(uintptr_t)))) {
+            ret = i;
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns the home slot of a block in profLive
+ *
+ * @param ptr User pointer of the block
+ *
+ * @return Slot index
+ */
+static uint32_t profLiveHash(uintptr_t ptr) {
+    return (uint32_t)(((ptr >> 4) * 0x9E3779B97F4A7C15ULL) >> 32) & (PROF_LIVE_NUM - 1);
+}
+
+/**
+ * @brief Adds a sampled block to profLive
+ *
+ * @note The caller must hold profLock
+ *
+ * @param ptr User pointer of the block
+ * @param size Requested size
+ * @param stack Slot of its stack
+ *
+ * @return 1 on success, 0 when the table is full
+ */
+static uint8_t profLiveInsert(uintptr_t ptr, size_t size, uint32_t stack) {
+    uint8_t ret = 0;
+
+    if (profLiveCount < PROF_LIVE_LOAD) {
+        uint32_t i = profLiveHash(ptr);
+
+        while (0 != profLive[i].ptr) {
+            i = (i + 1) & (PROF_LIVE_NUM - 1);
+        }
+        profLive[i].ptr = ptr;
+        profLive[i].size = size;
+        profLive[i].stack = stack;
+        profLiveCount++;
+        ret = 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Removes a sampled block from profLive
+ *
+ * The entries after it are shifted back into the hole, so no tombstone is left and the probes
+ * stay as short as they were before the insertion.
+ *
+ * @note The caller must hold profLock
+ *
+ * @param ptr User pointer of the block
+ * @param live Receives the removed entry
+ *
+ * @return 1 when the block was found, 0 otherwise
+ */
+static uint8_t profLiveRemove(uintptr_t ptr, prof_live_t *live) {
+    uint8_t ret = 0;
+    uint32_t i = profLiveHash(ptr);
+
+    while ((0 != profLive[i].ptr) && (ptr != profLive[i].ptr)) {
+        i = (i + 1) & (PROF_LIVE_NUM - 1);
+    }
+    if (ptr == profLive[i].ptr) {
+        uint32_t hole = i;
+
+        *live = profLive[i];
+        for (uint32_t j = (i + 1) & (PROF_LIVE_NUM - 1); 0 != profLive[j].ptr; j = (j + 1) & (PROF_LIVE_NUM - 1)) {
+            uint32_t home = profLiveHash(profLive[j].ptr);
+
+            // The entry may move back when the hole lies between its home slot and its slot
+            if (((j - home) & (PROF_LIVE_NUM - 1)) >= ((j - hole) & (PROF_LIVE_NUM - 1))) {
+                profLive[hole] = profLive[j];
+                hole = j;
+            }
+        }
+        profLive[hole].ptr = 0;
+        profLiveCount--;
+        ret = 1;
+    }
+    return ret;
+}
+
+/**
+ * @brief Releases profLock, writing first the profile a signal asked for while it was held
+ *
+ * A signal landing on another thread between the last check and the unlock fails its trylock
+ * and only sets profDumpPending, so the flag is checked again once unlocked: the lock is taken
+ * back to write that profile unless another thread holds it, which then writes it itself.
+ */
+static void profUnlock(void) {
+    uint8_t locked = 1;
+
+    while (locked) {
+        while (profDumpPending) {
+            profDumpPending = 0;
+            profDumpFile();
+        }
+        pthread_mutex_unlock(&profLock);
+        locked = (profDumpPending && (0 == pthread_mutex_trylock(&profLock))) ? 1 : 0;
+    }
+}
+
+/**
+ * @brief Writes the profile, see hmm_prof_dump
+ *
+ * Only write, open and read are called, the profile can be written from the signal handler.
+ *
+ * @note The caller must hold profLock
+ *
+ * @param fd File descriptor to write the profile to
+ */
+static void profWrite(int fd) {
+    char line[128 + PROF_DEPTH_MAX * 20];
+    size_t liveNum = 0, liveBytes = 0, allocNum = 0, allocBytes = 0;
+    int len = 0;
+
+    if (NULL != profStacks) {
+        for (uint32_t i = 0; i < PROF_STACK_NUM; i++) {
+            liveNum += profStacks[i].liveNum;
+            liveBytes += profStacks[i].liveBytes;
+            allocNum += profStacks[i].allocNum;
+            allocBytes += profStacks[i].allocBytes;
+        }
+        len = snprintf(line, sizeof(line), "heap profile: %zu: %zu [%zu: %zu] @ heap_v2/%zu\n",
+                       liveNum, liveBytes, allocNum, allocBytes, TUNE_GET(profSample));
+        write(fd, line, len);
+        for (uint32_t i = 0; i < PROF_STACK_NUM; i++) {
+            prof_stack_t *stack = &profStacks[i];
+
+            if (0 != stack->allocNum) {
+                len = snprintf(line, sizeof(line), "%zu: %zu [%zu: %zu] @", stack->liveNum, stack->liveBytes,
+                               stack->allocNum, stack->allocBytes);
+                for (uint32_t f = 0; f < stack->depth; f++) {
+                    len += snprintf(line + len, sizeof(line) - len, " 0x%lx", (unsigned long)stack->frame[f]);
+                }
+                line[len++] = '\n';
+                write(fd, line, len);
+            }
+        }
+
+        // pprof maps the frames to the binaries with the mappings of the process
+        int mapsFd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+        ssize_t readLen = 0;
+
+        write(fd, "\nMAPPED_LIBRARIES:\n", 19);
+        while ((mapsFd >= 0) && ((readLen = read(mapsFd, line, sizeof(line))) > 0)) {
+            write(fd, line, readLen);
+        }
+        if (mapsFd >= 0) {
+            close(mapsFd);
+        }
+    }
+}
+
+/**
+ * @brief Writes the profile to the next file <prefix>.<pid>.<n>.heap
+ *
+ * @note The caller must hold profLock
+ */
+static void profDumpFile(void) {
+    char name[256];
+    int fd = -1;
+
+    if (NULL != profStacks) {
+        snprintf(name, sizeof(name), "%s.%d.%u.heap", profFilePrefix, (int)getpid(), profDumpNum++);
+        fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            profWrite(fd);
+            close(fd);
+        }
+    }
+}
+
+/**
+ * @brief Handler of HMM_PROF_SIGNAL, writes a profile file
+ *
+ * When the tables are locked, by another thread or by the interrupted one, the thread holding
+ * them writes the profile as it releases them.
+ *
+ * @param sig Signal received
+ */
+static void profSignal(int sig) {
+    int savedErrno = errno;
+
+    (void)sig;
+    profDumpPending = 1;
+    if (0 == pthread_mutex_trylock(&profLock)) {
+        profUnlock();
+    }
+    errno = savedErrno;
+}
+
+/**
+ * @brief atexit handler writing the last profile when HMM_PROF_FILE is set
+ */
+static void profProcessExit(void) {
+    pthread_mutex_lock(&profLock);
+    profDumpFile();
+    profUnlock();
+}
+
+/**
+ * @brief Takes profLock before fork, so the child never inherits it locked by another thread
+ *
+ * It runs before the prepare handler of the arenas (profInit is called after it is registered),
+ * since a sampled block is resized or flagged with profLock held while taking an arena lock.
+ */
+static void profForkPrepare(void) {
+    pthread_mutex_lock(&profLock);
+}
+
+/**
+ * @brief Releases profLock in the parent after fork
+ */
+static void profForkParent(void) {
+    pthread_mutex_unlock(&profLock);
+}
+
+/**
+ * @brief Releases profLock in the child after fork, it keeps the profile of the parent
+ */
+static void profForkChild(void) {
+    pthread_mutex_unlock(&profLock);
+}
@@ -0,0 +1,118 @@
+#ifndef PROFILE_H  // Include guard to prevent multiple inclusions
+#define PROFILE_H
+
+#include <stdint.h>  // For the frame addresses
+#include <stddef.h>  // For size_t
+#include "./../DoubleLinkedList/DoubleLinkedList.h"  // node_t is the chunk metadata
+
+#define PROF_SAMPLE_MAX (1024*1024*1024) // Longest mean sampling interval
+#define PROF_FILE_ENV "HMM_PROF_FILE" // Prefix of the profiles written on the signal, and at exit when it is set
+#define PROF_FILE_DEFAULT "hmm" // Prefix used without HMM_PROF_FILE, profiles are named <prefix>.<pid>.<n>.heap
+#define PROF_SIGNAL_ENV "HMM_PROF_SIGNAL" // Number of the signal dumping a profile
+#define PROF_SAMPLED_FLAG 0x8 // Set in the metadata of an allocated heap or mapped chunk that was sampled, shares the bit of DIRTY_CHUNK_FLAG (free chunks only)
+#define PROF_DEPTH_MAX 32 // Frames kept per stack, the outermost ones are dropped
+#define PROF_STACK_NUM 8192 // Distinct stacks of the profile (power of two)
+#define PROF_LIVE_NUM 65536 // Sampled blocks live at the same time (power of two)
+
+// Samples an allocation once profiling is on, a single predicted branch otherwise
+#define PROF_ALLOC(ptr, size) \
+    do { if (__builtin_expect(0 != TUNE_GET(profSample), 0)) { profAlloc((ptr), (size)); } } while (0)
+
+// Retires a sampled block from the profile before it is freed, nothing is read before a block was ever sampled
+#define PROF_FREE(ptr) \
+    do { if (__builtin_expect(profSampledAny, 0) && (NULL != (ptr))) { profFree(ptr); } } while (0)
+
+// Tells whether a block about to be resized was sampled, and then locks the profile until PROF_RESIZE_END
+#define PROF_RESIZE_START(ptr) (__builtin_expect(profSampledAny, 0) && profResizeStart(ptr))
+
+// Retires a sampled block once it was resized (newptr not NULL) and unlocks the profile
+#define PROF_RESIZE_END(sampled, ptr, newptr) \
+    do { if (__builtin_expect((sampled), 0)) { profResizeEnd((ptr), (newptr)); } } while (0)
+
+/**
+ * @brief Allocation stack of the profile and the sampled blocks it allocated
+ */
+typedef struct prof_stack {
+  uint64_t hash;                       // Hash of the frames, 0 for a free slot
+  uint32_t depth;                      // Frames in frame[]
+  uintptr_t frame[PROF_DEPTH_MAX];     // Return addresses, innermost first
+  size_t liveNum;                      // Sampled blocks of the stack not freed yet
+  size_t liveBytes;                    // Their requested bytes
+  size_t allocNum;                     // Sampled blocks ever allocated by the stack
+  size_t allocBytes;                   // Their requested bytes
+} prof_stack_t;
+
+/**
+ * @brief Sampled block not freed yet
+ */
+typedef struct prof_live {
+  uintptr_t ptr;                       // User pointer of the block, 0 for a free slot
+  size_t size;                         // Requested size
+  uint32_t stack;                      // Slot of its stack
+} prof_live_t;
+
+extern uint8_t profSampledAny; // Set by the first sample, a block may be flagged as sampled from then on
+
+/**
+ * @brief Reads HMM_PROF_FILE and HMM_PROF_SIGNAL, called once from the library constructor
+ *
+ * @return Nothing
+ */
+void profInit(void);
+
+/**
+ * @brief Counts an allocation against the sampling interval of the calling thread and samples it when due
+ *
+ * @param ptr Block returned by the allocation, NULL when it failed
+ * @param size Requested size
+ *
+ * @return Nothing
+ */
+void profAlloc(void *ptr, size_t size);
+
+/**
+ * @brief Retires a block from the bytes live of its stack and clears its flag, when it was sampled
+ *
+ * @param ptr Block about to be freed
+ *
+ * @return Nothing
+ */
+void profFree(void *ptr);
+
+/**
+ * @brief Locks the profile before a sampled block is resized in place or with mremap
+ *
+ * The block keeps its profile entry until the resize is known to succeed, and a block moved by
+ * mremap leaves the profile before another allocation can be sampled at its old address.
+ *
+ * @param ptr Block about to be resized
+ *
+ * @return 1 when the block was sampled and the profile is locked, 0 otherwise
+ */
+uint8_t profResizeStart(void *ptr);
+
+/**
+ * @brief Retires a sampled block when its resize succeeded, and unlocks the profile
+ *
+ * @param ptr Block that was resized
+ * @param newptr Resized block, ptr when it stayed in place, NULL when the resize failed
+ *
+ * @return Nothing
+ */
+void profResizeEnd(void *ptr, void *newptr);
+
+/**
+ * @brief Writes the heap profile in the legacy text format of pprof (heap_v2)
+ *
+ * Every stack lists its live sampled blocks and bytes, then all those it ever sampled.
+ * pprof scales them by the sampling interval of the header and symbolizes the frames with the
+ * MAPPED_LIBRARIES section, e.g. pprof --text ./program hmm.1234.0.heap.
+ * Nothing is written while profiling was never on.
+ *
+ * @param fd File descriptor to write the profile to
+ *
+ * @return Nothing
+ */
+void hmm_prof_dump(int fd);
+
+#endif  // PROFILE_H
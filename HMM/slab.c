@@ -0,0 +1,209 @@
+/*
+ * File: slab.c
+ * Description: segregated size-class slabs serving the small allocations in O(1).
+ * Author: Mohamed Eslam
+ */
+
+#include <sys/mman.h> // For mmap and munmap
+#include "hmm.h"
+
+static slab_span_t * newSpan(arena_t *arena, uint32_t classIndex);
+
+// Object size of every size class, the objects have no metadata
+const size_t slabClassSize[SLAB_CLASS_NUM] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 528
+};
+// Smallest class holding (index << 4) bytes
+const uint8_t slabClassIndex[(SLAB_MAX_SIZE >> 4) + 1] = {
+    0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+    12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15, 15
+};
+
+
+/**
+ * @brief Allocates an object from the slab of a size class
+ *
+ * The first span of the class partial list always has a free object, so the allocation
+ * either pops its embedded free list or advances its bump pointer. A new span is mapped
+ * only when the class has no partial span left.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param classIndex Size class, usually SLAB_CLASS_OF(size)
+ *
+ * @return Pointer to the object, or NULL on failure
+ */
+node_t *slabAlloc(arena_t *arena, uint32_t classIndex) {
+    node_t *chunk = NULL;
+    slab_span_t *span = NULL;
+
+    span = (slab_span_t *)arena->slabPartialList[classIndex].head;
+    if (NULL == span) {
+        span = newSpan(arena, classIndex);
+        if (NULL != span) {
+            listPushFront(&arena->slabPartialList[classIndex], &span->node);
+        }
+    }
+
+    if (NULL != span) {
+        if (NULL != span->freeList) {
+            chunk = span->freeList; // Reuse the most recently freed object
+            span->freeList = chunk->next;
+        } else {
+            chunk = (node_t *)span->bump; // Carve an object that was never used
+            span->bump += slabClassSize[classIndex];
+        }
+        span->usedNum++;
+        arena->slabUsedNum[classIndex]++;
+
+        // A full span leaves the partial list until one of its objects is freed
+        if ((NULL == span->freeList) && (span->bump + slabClassSize[classIndex] > span->end)) {
+            listRemove(&arena->slabPartialList[classIndex], &span->node);
+        }
+    }
+    return chunk;
+}
+
+/**
+ * @brief Allocates several objects from the slab of a size class in one pass
+ *
+ * Every span of the class partial list is emptied in turn, its freed objects first and then its
+ * bump pointer, so a burst costs one span lookup per span instead of one per object. The used
+ * counts are updated once per span and a span leaves the partial list once it is full, like
+ * slabAlloc does.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param classIndex Size class, usually SLAB_CLASS_OF(size)
+ * @param chunks Receives the pointers to the objects
+ * @param num Number of objects wanted
+ *
+ * @return Number of objects allocated, less than 'num' only when a span could not be mapped
+ */
+size_t slabAllocBatch(arena_t *arena, uint32_t classIndex, void **chunks, size_t num) {
+    size_t allocNum = 0;
+    size_t classSize = slabClassSize[classIndex];
+    list_t *partialList = &arena->slabPartialList[classIndex];
+
+    while (allocNum < num) {
+        slab_span_t *span = (slab_span_t *)partialList->head;
+        size_t spanNum = 0; // Objects taken from this span
+
+        if (NULL == span) {
+            span = newSpan(arena, classIndex);
+            if (NULL == span) {
+                break;
+            }
+            listPushFront(partialList, &span->node);
+        }
+        while ((allocNum + spanNum < num) && (NULL != span->freeList)) {
+            node_t *chunk = span->freeList;
+            span->freeList = chunk->next;
+            chunks[allocNum + spanNum++] = chunk;
+        }
+        while ((allocNum + spanNum < num) && (span->bump + classSize <= span->end)) {
+            node_t *chunk = (node_t *)span->bump;
+            span->bump += classSize;
+            chunks[allocNum + spanNum++] = chunk;
+        }
+        span->usedNum += spanNum;
+        arena->slabUsedNum[classIndex] += spanNum;
+        allocNum += spanNum;
+
+        if ((NULL == span->freeList) && (span->bump + classSize > span->end)) {
+            listRemove(partialList, &span->node);
+        }
+    }
+    return allocNum;
+}
+
+/**
+ * @brief Returns an object to the span it was carved from
+ *
+ * The owning span is found by aligning the object address down to SLAB_SPAN_SIZE,
+ * so this never touches the general free list. A span that becomes empty is unmapped
+ * unless it is the last partial span of its class, which is kept to avoid mapping
+ * and unmapping the same span on every alloc/free pair. It leaves the page map first.
+ *
+ * @note The caller must hold the lock of the arena owning the span (SLAB_SPAN_OF(chunk)->arena)
+ *
+ * @param chunk Pointer to an object returned by slabAlloc
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t slabFree(node_t *chunk) {
+    return_status_t ret = OK;
+
+    if (NULL == chunk) {
+        ret = NULLPTR;
+    } else {
+        slab_span_t *span = SLAB_SPAN_OF(chunk);
+        size_t classSize = slabClassSize[span->classIndex];
+        uint8_t wasFull = (NULL == span->freeList) && (span->bump + classSize > span->end);
+
+        chunk->next = span->freeList;
+        span->freeList = chunk;
+        span->usedNum--;
+        span->arena->slabUsedNum[span->classIndex]--;
+
+        list_t *partialList = &span->arena->slabPartialList[span->classIndex];
+
+        if (wasFull) {
+            listPushFront(partialList, &span->node);
+        } else if ((0 == span->usedNum) && (partialList->count > 1)) {
+            listRemove(partialList, &span->node);
+            span->arena->slabSpanNum--;
+            pageMapClear(span);
+            munmap(span, SLAB_SPAN_SIZE);
+        } else {
+            // The span stays in the partial list
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Maps a new SLAB_SPAN_SIZE aligned span for a size class
+ *
+ * mmap only guarantees page alignment, so twice the span size is mapped and
+ * the unaligned head and tail are unmapped again. The span is recorded in the page map,
+ * it is given back when the map cannot grow.
+ *
+ * @param arena Arena owning the span
+ * @param classIndex Size class the span will serve
+ *
+ * @return Pointer to the initialized span, or NULL if the mapping failed
+ */
+static slab_span_t * newSpan(arena_t *arena, uint32_t classIndex) {
+    slab_span_t *span = NULL;
+    uint8_t *map = mmap(NULL, 2 * SLAB_SPAN_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (MAP_FAILED != map) {
+        uint8_t *aligned = (uint8_t *)(((uintptr_t)map + SLAB_SPAN_SIZE - 1) & ~((uintptr_t)SLAB_SPAN_SIZE - 1));
+        if (aligned != map) {
+            munmap(map, aligned - map);
+        }
+        munmap(aligned + SLAB_SPAN_SIZE, (map + 2 * SLAB_SPAN_SIZE) - (aligned + SLAB_SPAN_SIZE));
+
+        if (!pageMapSet((slab_span_t *)aligned, classIndex)) {
+            munmap(aligned, SLAB_SPAN_SIZE); // free could not find its objects
+        } else {
+            span = (slab_span_t *)aligned;
+            span->node.size = SLAB_SPAN_SIZE;
+            span->node.next = NULL;
+            span->node.prev = NULL;
+            span->freeList = NULL;
+            // Objects start at the first 16-byte boundary past the header, their sizes keep that alignment
+            span->bump = aligned + ((sizeof(slab_span_t) + 15) & ~(size_t)15);
+            span->end = aligned + SLAB_SPAN_SIZE;
+            span->arena = arena;
+            span->classIndex = classIndex;
+            span->usedNum = 0;
+            arena->slabSpanNum++;
+        }
+    }
+    return span;
+}
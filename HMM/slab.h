@@ -0,0 +1,82 @@
+#ifndef SLAB_H  // Include guard to prevent multiple inclusions
+#define SLAB_H
+
+#include "./../DoubleLinkedList/DoubleLinkedList.h"  // node_t is reused as the span link
+
+#define SLAB_SPAN_SIZE (64*1024) // Size (and alignment) of one slab span requested with mmap
+#define SLAB_MAX_SIZE 528 // Largest request served by the slabs, their objects have no metadata
+#define SLAB_CLASS_NUM 16 // Number of fixed size classes
+#define SLAB_CLASS_OF(size) (slabClassIndex[((size) + 15) >> 4]) // Smallest class fitting a request size
+#define SLAB_SAMPLED_WORDS (SLAB_SPAN_SIZE / 16 / 64) // Words of the bitmap of the sampled objects, a bit per 16 bytes
+#define SLAB_SPAN_OF(chunk) ((slab_span_t *)((uintptr_t)(chunk) & ~((uintptr_t)SLAB_SPAN_SIZE - 1))) // Span of a chunk
+
+struct arena; // Defined in arena.h, every span belongs to one arena
+
+/**
+ * @brief Header stored at the beginning of every slab span
+ *
+ * A span is a SLAB_SPAN_SIZE aligned region holding objects of a single size class.
+ * The objects carry no metadata, free finds their span and class through the page map.
+ * Freed objects are kept in an embedded singly linked list threaded through their payload,
+ * objects that were never handed out are carved from the bump pointer.
+ */
+typedef struct slab_span {
+  node_t node;             // Links the span in the partial list of its class (node.size = SLAB_SPAN_SIZE)
+  node_t *freeList;        // Embedded list of freed objects (linked through node_t.next)
+  uint8_t *bump;           // Next object that was never handed out
+  uint8_t *end;            // End of the usable area of the span
+  struct arena *arena;     // Arena owning the span
+  uint32_t classIndex;     // Size class of all the objects in this span
+  uint32_t usedNum;        // Number of objects currently handed out
+  uint64_t sampled[SLAB_SAMPLED_WORDS]; // Objects sampled by the heap profiler, by 16-byte offset in the span
+} slab_span_t;
+
+extern const size_t slabClassSize[SLAB_CLASS_NUM]; // Object size of every size class
+extern const uint8_t slabClassIndex[(SLAB_MAX_SIZE >> 4) + 1]; // Maps (size >> 4) rounded up to its class
+
+/**
+ * @brief Allocates an object from the slab of a size class
+ *
+ * The object is the user area itself, 16-byte aligned, and holds no metadata.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param classIndex Size class, usually SLAB_CLASS_OF(size)
+ *
+ * @return Pointer to the object, or NULL on failure
+ */
+node_t *slabAlloc(struct arena *arena, uint32_t classIndex);
+
+/**
+ * @brief Allocates several objects from the slab of a size class in one pass
+ *
+ * Every span of the class partial list is emptied in turn, its freed objects first and then its
+ * bump pointer, so a burst costs one span lookup per span instead of one per object.
+ *
+ * @note The caller must hold the arena lock
+ *
+ * @param arena Arena to allocate from
+ * @param classIndex Size class, usually SLAB_CLASS_OF(size)
+ * @param chunks Receives the pointers to the objects
+ * @param num Number of objects wanted
+ *
+ * @return Number of objects allocated, less than 'num' only when a span could not be mapped
+ */
+size_t slabAllocBatch(struct arena *arena, uint32_t classIndex, void **chunks, size_t num);
+
+/**
+ * @brief Returns an object to the span it was carved from
+ *
+ * The owning span is found by aligning the object address down to SLAB_SPAN_SIZE,
+ * so this never touches the general free list.
+ *
+ * @note The caller must hold the lock of the arena owning the span (SLAB_SPAN_OF(chunk)->arena)
+ *
+ * @param chunk Pointer to an object returned by slabAlloc
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t slabFree(node_t *chunk);
+
+#endif  // SLAB_H
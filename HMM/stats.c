@@ -0,0 +1,165 @@
+/*
+ * File: stats.c
+ * Description: counters of the heap manager and the mallinfo2/malloc_stats reports built on them.
+ * Author: Mohamed Eslam
+ */
+
+#include "hmm.h"
+
+static void arenaStats(arena_t *arena, hmm_stats_t *stats);
+static size_t hugePageBytes(void);
+
+hmm_stats_t hmmStatsCounters; // The shared counters, bumped with STATS_ADD
+
+
+/**
+ * @brief Copies the heap manager counters
+ *
+ * The shared counters are read atomically and the counters of every arena under its lock,
+ * the set is not a snapshot of a single instant. The size class counts of the running threads
+ * lag by less than STATS_FOLD_NUM per class and thread.
+ *
+ * @param stats Output counters
+ *
+ * @return Nothing
+ */
+void hmm_stats(hmm_stats_t *stats) {
+    if (NULL != stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->reallocNum = __atomic_load_n(&hmmStatsCounters.reallocNum, __ATOMIC_RELAXED);
+        stats->reallocInPlaceNum = __atomic_load_n(&hmmStatsCounters.reallocInPlaceNum, __ATOMIC_RELAXED);
+        stats->reallocRemapNum = __atomic_load_n(&hmmStatsCounters.reallocRemapNum, __ATOMIC_RELAXED);
+        stats->mmapNum = __atomic_load_n(&hmmStatsCounters.mmapNum, __ATOMIC_RELAXED);
+        stats->mmapBytes = __atomic_load_n(&hmmStatsCounters.mmapBytes, __ATOMIC_RELAXED);
+        for (uint32_t i = 0; i < SLAB_CLASS_NUM; i++) {
+            stats->classAllocNum[i] = __atomic_load_n(&hmmStatsCounters.classAllocNum[i], __ATOMIC_RELAXED);
+            stats->classHitNum[i] = __atomic_load_n(&hmmStatsCounters.classHitNum[i], __ATOMIC_RELAXED);
+        }
+        for (uint32_t i = 0; i < ARENA_MAX_NUM; i++) {
+            arenaStats(&arenaTable[i], stats);
+        }
+    }
+}
+
+/**
+ * @brief Reports the heap usage in the glibc mallinfo2 format
+ *
+ * arena is the heap and slab memory, ordblks/fordblks the free chunks and bytes, uordblks the
+ * bytes in use and hblks/hblkhd the blocks having their own mapping. The fastbin fields, usmblks
+ * and keepcost are not tracked and stay zero.
+ *
+ * @return The usage
+ */
+struct mallinfo2 mallinfo2(void) {
+    struct mallinfo2 info;
+    hmm_stats_t stats;
+
+    memset(&info, 0, sizeof(info));
+    hmm_stats(&stats);
+    info.arena = stats.heapBytes + stats.slabBytes;
+    info.ordblks = stats.freeChunkNum;
+    info.hblks = stats.mmapNum;
+    info.hblkhd = stats.mmapBytes;
+    info.uordblks = stats.inUseBytes;
+    info.fordblks = stats.freeBytes;
+    return info;
+}
+
+/**
+ * @brief Prints the heap usage of every arena and the totals on stderr
+ *
+ * Like glibc, one section per arena in use then the totals, followed by the free chunks,
+ * the heap growths and trims, the bytes of the process backed by transparent huge pages and the
+ * thread cache hit rate of every size class.
+ *
+ * @return Nothing
+ */
+void malloc_stats(void) {
+    hmm_stats_t stats;
+
+    for (uint32_t i = 0; i < ARENA_MAX_NUM; i++) {
+        hmm_stats_t arenaTotal;
+
+        memset(&arenaTotal, 0, sizeof(arenaTotal));
+        arenaStats(&arenaTable[i], &arenaTotal);
+        if ((0 != arenaTotal.heapBytes) || (0 != arenaTotal.slabBytes)) {
+            fprintf(stderr, "Arena %u:\n", i);
+            fprintf(stderr, "system bytes     = %10zu\n", arenaTotal.heapBytes + arenaTotal.slabBytes);
+            fprintf(stderr, "in use bytes     = %10zu\n", arenaTotal.inUseBytes);
+        }
+    }
+    hmm_stats(&stats);
+    fprintf(stderr, "Total (incl. mmap):\n");
+    fprintf(stderr, "system bytes     = %10zu\n", stats.heapBytes + stats.slabBytes + stats.mmapBytes);
+    fprintf(stderr, "in use bytes     = %10zu\n", stats.inUseBytes + stats.mmapBytes);
+    fprintf(stderr, "mmap regions     = %10zu\n", stats.mmapNum);
+    fprintf(stderr, "mmap bytes       = %10zu\n", stats.mmapBytes);
+    fprintf(stderr, "free chunks      = %10zu\n", stats.freeChunkNum);
+    fprintf(stderr, "free bytes       = %10zu\n", stats.freeBytes);
+    fprintf(stderr, "largest free     = %10zu\n", stats.largestFreeChunk);
+    fprintf(stderr, "heap grows/trims = %10zu / %zu\n", stats.growNum, stats.trimNum);
+    fprintf(stderr, "dirty bytes      = %10zu\n", stats.dirtyBytes);
+    fprintf(stderr, "huge page bytes  = %10zu\n", hugePageBytes());
+    for (uint32_t i = 0; i < SLAB_CLASS_NUM; i++) {
+        if (0 != stats.classAllocNum[i]) {
+            fprintf(stderr, "class %4zu bytes = %10zu allocs, %5.1f%% cache hits\n", slabClassSize[i],
+                    stats.classAllocNum[i], 100.0 * stats.classHitNum[i] / stats.classAllocNum[i]);
+        }
+    }
+}
+
+/**
+ * @brief Adds the counters of one arena to a set of counters
+ *
+ * @param arena Arena to read, locked while it is read
+ * @param stats Counters to add to
+ */
+static void arenaStats(arena_t *arena, hmm_stats_t *stats) {
+    size_t slabUsedBytes = 0; // Bytes of the slab objects out of their spans
+    size_t largest = 0;
+
+    pthread_mutex_lock(&arena->lock);
+    for (uint32_t i = 0; i < SLAB_CLASS_NUM; i++) {
+        slabUsedBytes += arena->slabUsedNum[i] * slabClassSize[i];
+    }
+    stats->inUseBytes += arena->inUseBytes + slabUsedBytes;
+    stats->freeBytes += arena->freeIndex.freeBytes + (arena->slabSpanNum * SLAB_SPAN_SIZE - slabUsedBytes);
+    stats->heapBytes += arena->heapBytes;
+    stats->slabBytes += arena->slabSpanNum * SLAB_SPAN_SIZE;
+    stats->freeChunkNum += arena->freeIndex.freeNum;
+    stats->growNum += arena->growNum;
+    stats->trimNum += arena->trimNum;
+    stats->dirtyBytes += arena->dirtyBytes;
+    largest = heapLargestFree(arena);
+    pthread_mutex_unlock(&arena->lock);
+
+    if (largest > stats->largestFreeChunk) {
+        stats->largestFreeChunk = largest;
+    }
+}
+
+/**
+ * @brief Reads the anonymous memory of the process backed by transparent huge pages
+ *
+ * The whole process is counted (AnonHugePages of /proc/self/smaps_rollup), not only the heaps.
+ *
+ * @return Number of bytes, 0 when the kernel does not report it
+ */
+static size_t hugePageBytes(void) {
+    size_t bytes = 0;
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+
+    if (NULL != file) {
+        char line[128];
+        size_t kiloBytes = 0;
+
+        while (NULL != fgets(line, sizeof(line), file)) {
+            if (1 == sscanf(line, "AnonHugePages: %zu kB", &kiloBytes)) {
+                bytes = kiloBytes * 1024;
+                break;
+            }
+        }
+        fclose(file);
+    }
+    return bytes;
+}
@@ -0,0 +1,65 @@
+#ifndef STATS_H  // Include guard to prevent multiple inclusions
+#define STATS_H
+
+#include <stddef.h>  // For size_t
+#include <malloc.h>  // For struct mallinfo2
+#include "slab.h"  // For the number of size classes
+
+#define STATS_ADD(counter, num) __atomic_fetch_add(&hmmStatsCounters.counter, (num), __ATOMIC_RELAXED) // Bumps a counter
+#define STATS_SUB(counter, num) __atomic_fetch_sub(&hmmStatsCounters.counter, (num), __ATOMIC_RELAXED) // Decreases a counter
+#define STATS_FOLD_NUM 256 // The thread caches add their counts to the shared counters in batches of this size
+
+/**
+ * @brief Counters of the heap manager, read with hmm_stats()
+ *
+ * The shared counters (realloc, mapped blocks, size classes) are relaxed atomics, they cost
+ * a single locked add and are never read back on the allocation paths; the size class counts
+ * are added by every thread cache once per STATS_FOLD_NUM allocations. The heap and slab
+ * counters are kept per arena under its lock and summed by hmm_stats, so reading them never
+ * walks a free list.
+ */
+typedef struct hmm_stats {
+  size_t reallocNum;           // realloc calls resizing an existing block
+  size_t reallocInPlaceNum;    // Those that kept the block where it was
+  size_t reallocRemapNum;      // Those that resized a mapped block with mremap, without copying
+  size_t inUseBytes;           // Bytes of the allocated heap chunks and slab objects, metadata included
+  size_t freeBytes;            // Bytes of the free heap chunks and of the free space of the slab spans
+  size_t heapBytes;            // Bytes of heap obtained with sbrk and in the arena regions
+  size_t slabBytes;            // Bytes of the mapped slab spans
+  size_t mmapNum;              // Blocks having a mapping of their own
+  size_t mmapBytes;            // Bytes of those mappings
+  size_t freeChunkNum;         // Free heap chunks
+  size_t largestFreeChunk;     // Size of the largest free heap chunk
+  size_t growNum;              // Heap growths (sbrk calls, arena break moves, new regions)
+  size_t trimNum;              // Heap memory given back to the OS (sbrk shrinks, madvise)
+  size_t dirtyBytes;           // Bytes of free heap pages waiting for the decay to purge them
+  size_t classAllocNum[SLAB_CLASS_NUM]; // Small allocations per size class
+  size_t classHitNum[SLAB_CLASS_NUM];   // Those served by the thread cache, without taking a lock
+} hmm_stats_t;
+
+extern hmm_stats_t hmmStatsCounters; // The shared counters, the per-arena ones are not used
+
+/**
+ * @brief Copies the heap manager counters
+ *
+ * @param stats Output counters
+ *
+ * @return Nothing
+ */
+void hmm_stats(hmm_stats_t *stats);
+
+/**
+ * @brief Reports the heap usage in the glibc mallinfo2 format
+ *
+ * @return The usage, the fields glibc keeps for its fastbins are zero
+ */
+struct mallinfo2 mallinfo2(void);
+
+/**
+ * @brief Prints the heap usage of every arena and the totals on stderr
+ *
+ * @return Nothing
+ */
+void malloc_stats(void);
+
+#endif  // STATS_H
@@ -0,0 +1,252 @@
+/*
+ * File: tcache.c
+ * Description: per-thread caches of small chunks, the lock-free fast path of malloc and free.
+ * Author: Mohamed Eslam
+ */
+
+#include <pthread.h> // For the thread-specific key draining the caches
+#include "hmm.h"
+#include "tcache.h"
+
+static void tcacheFlush(tcache_t *cache, uint32_t classIndex, uint32_t num);
+static void tcacheFoldStats(tcache_t *cache, uint32_t classIndex);
+static void tcacheDrain(void *arg);
+static void tcacheRegister(tcache_t *cache);
+
+// initial-exec keeps the access a plain offset from the thread pointer, without __tls_get_addr
+static __thread tcache_t threadCache __attribute__((tls_model("initial-exec")));
+static pthread_key_t tcacheKey; // Its destructor drains the cache of an exiting thread
+static uint8_t tcacheKeyReady = 0; // Set once tcacheKey was created
+
+
+/**
+ * @brief Creates the thread-specific key used to drain the caches at thread exit
+ *
+ * Called once from the library constructor. Threads that allocate before it runs
+ * simply are not drained at exit.
+ *
+ * @return Nothing
+ */
+void tcacheInit(void) {
+    if (0 == pthread_key_create(&tcacheKey, tcacheDrain)) {
+        tcacheKeyReady = 1;
+    }
+}
+
+/**
+ * @brief Allocates a small chunk from the calling thread cache
+ *
+ * When the bin is empty it is refilled with TCACHE_BATCH chunks taken from the slabs
+ * of the thread arena under a single acquisition of its lock. Once the thread cache was
+ * drained at thread exit, the chunk comes straight from the slabs.
+ * The hits and allocations are counted locally and added to the shared counters in batches.
+ *
+ * @param classIndex Size class of the requested chunk
+ *
+ * @return Pointer to the object, which is the user area, or NULL on failure
+ */
+node_t *tcacheAlloc(uint32_t classIndex) {
+    tcache_t *cache = &threadCache;
+    node_t *chunk = NULL;
+
+    if (TCACHE_SHUTDOWN == cache->state) {
+        arena_t *arena = arenaGet();
+        pthread_mutex_lock(&arena->lock);
+        chunk = slabAlloc(arena, classIndex);
+        pthread_mutex_unlock(&arena->lock);
+        STATS_ADD(classAllocNum[classIndex], 1);
+    } else {
+        if (NULL == cache->bin[classIndex]) {
+            if (TCACHE_UNINIT == cache->state) {
+                tcacheRegister(cache);
+            }
+            // Refill the bin in one batch, no deeper than the bin may be
+            arena_t *arena = arenaGet();
+            uint32_t batch = TUNE_GET(tcacheCount);
+            batch = (batch < TCACHE_BATCH) ? batch : TCACHE_BATCH;
+            pthread_mutex_lock(&arena->lock);
+            for (uint32_t i = 0; i < batch; i++) {
+                node_t *newChunk = slabAlloc(arena, classIndex);
+                if (NULL == newChunk) {
+                    break;
+                }
+                newChunk->next = cache->bin[classIndex];
+                cache->bin[classIndex] = newChunk;
+                cache->count[classIndex]++;
+            }
+            pthread_mutex_unlock(&arena->lock);
+        } else {
+            cache->hitNum[classIndex]++;
+        }
+        if (++cache->allocNum[classIndex] >= STATS_FOLD_NUM) {
+            tcacheFoldStats(cache, classIndex);
+        }
+
+        chunk = cache->bin[classIndex];
+        if (NULL != chunk) {
+            cache->bin[classIndex] = chunk->next;
+            cache->count[classIndex]--;
+        }
+    }
+    return chunk;
+}
+
+/**
+ * @brief Allocates several small chunks of one size class for hmm_malloc_batch
+ *
+ * The bin of the calling thread cache is emptied first, those chunks count as cache hits. The
+ * rest is carved from the slabs of the thread arena with slabAllocBatch under a single
+ * acquisition of its lock, without going through the bin, and is added to the shared counters
+ * at once.
+ *
+ * @param classIndex Size class of the requested chunks
+ * @param chunks Receives the pointers to the objects
+ * @param num Number of chunks wanted
+ *
+ * @return Number of chunks allocated, less than 'num' only on failure
+ */
+size_t tcacheAllocBatch(uint32_t classIndex, void **chunks, size_t num) {
+    tcache_t *cache = &threadCache;
+    size_t allocNum = 0;
+
+    if (TCACHE_SHUTDOWN != cache->state) {
+        while ((allocNum < num) && (NULL != cache->bin[classIndex])) {
+            node_t *chunk = cache->bin[classIndex];
+            cache->bin[classIndex] = chunk->next;
+            cache->count[classIndex]--;
+            chunks[allocNum++] = chunk;
+        }
+        cache->allocNum[classIndex] += allocNum;
+        cache->hitNum[classIndex] += allocNum;
+        if (cache->allocNum[classIndex] >= STATS_FOLD_NUM) {
+            tcacheFoldStats(cache, classIndex);
+        }
+    }
+    if (allocNum < num) {
+        arena_t *arena = arenaGet();
+        size_t slabNum = 0;
+
+        pthread_mutex_lock(&arena->lock);
+        slabNum = slabAllocBatch(arena, classIndex, chunks + allocNum, num - allocNum);
+        pthread_mutex_unlock(&arena->lock);
+        STATS_ADD(classAllocNum[classIndex], slabNum);
+        allocNum += slabNum;
+    }
+    return allocNum;
+}
+
+/**
+ * @brief Puts a freed small chunk in the calling thread cache
+ *
+ * The objects have no metadata, the caller gives the class: free reads it from the page map,
+ * the sized frees derive it from the size they were given. An object of a larger class than
+ * the bin is harmless: it serves a smaller request, the page map still reports its own size,
+ * and it goes back to its span, which knows its class, when flushed.
+ * When the bin is full (TCACHE_MAX_COUNT chunks by default, HMM_TCACHE_COUNT), TCACHE_BATCH chunks
+ * are flushed back to their slab spans.
+ * Once the thread cache was drained at thread exit, the chunk goes straight back to its span.
+ *
+ * @param chunk Pointer to a slab object
+ * @param classIndex Size class of the object, or of a smaller size it can serve
+ *
+ * @return return_status_t indicating success (OK).
+ */
+return_status_t tcacheFree(node_t *chunk, uint32_t classIndex) {
+    tcache_t *cache = &threadCache;
+    return_status_t ret = OK;
+
+    if (TCACHE_SHUTDOWN == cache->state) {
+        arena_t *arena = SLAB_SPAN_OF(chunk)->arena;
+        pthread_mutex_lock(&arena->lock);
+        ret = slabFree(chunk);
+        pthread_mutex_unlock(&arena->lock);
+    } else {
+        if (TCACHE_UNINIT == cache->state) {
+            tcacheRegister(cache);
+        }
+        if (cache->count[classIndex] >= TUNE_GET(tcacheCount)) {
+            tcacheFlush(cache, classIndex, TCACHE_BATCH);
+        }
+        chunk->next = cache->bin[classIndex];
+        cache->bin[classIndex] = chunk;
+        cache->count[classIndex]++;
+    }
+    return ret;
+}
+
+/**
+ * @brief Returns chunks of one bin to their slab spans
+ *
+ * Every chunk goes back to the arena owning its span, which is not always the arena of the
+ * calling thread. The lock is only switched when two consecutive chunks belong to different
+ * arenas, so a bin filled by one arena is flushed under a single acquisition.
+ *
+ * @param cache Thread cache to flush
+ * @param classIndex Bin to flush
+ * @param num Maximum number of chunks to flush
+ */
+static void tcacheFlush(tcache_t *cache, uint32_t classIndex, uint32_t num) {
+    arena_t *lockedArena = NULL;
+
+    while ((num > 0) && (NULL != cache->bin[classIndex])) {
+        node_t *chunk = cache->bin[classIndex];
+        arena_t *arena = SLAB_SPAN_OF(chunk)->arena;
+
+        if (arena != lockedArena) {
+            if (NULL != lockedArena) {
+                pthread_mutex_unlock(&lockedArena->lock);
+            }
+            pthread_mutex_lock(&arena->lock);
+            lockedArena = arena;
+        }
+        cache->bin[classIndex] = chunk->next;
+        cache->count[classIndex]--;
+        slabFree(chunk);
+        num--;
+    }
+    if (NULL != lockedArena) {
+        pthread_mutex_unlock(&lockedArena->lock);
+    }
+}
+
+/**
+ * @brief Destructor of tcacheKey, drains the cache of an exiting thread
+ *
+ * Frees issued by later destructors of the same thread bypass the cache.
+ *
+ * @param arg Thread cache registered with pthread_setspecific
+ */
+static void tcacheDrain(void *arg) {
+    tcache_t *cache = (tcache_t *)arg;
+
+    cache->state = TCACHE_SHUTDOWN;
+    for (uint32_t i = 0; i < SLAB_CLASS_NUM; i++) {
+        tcacheFlush(cache, i, UINT32_MAX);
+        tcacheFoldStats(cache, i);
+    }
+}
+
+/**
+ * @brief Adds the local counts of one class to the shared counters
+ *
+ * @param cache Thread cache of the calling thread
+ * @param classIndex Size class to fold
+ */
+static void tcacheFoldStats(tcache_t *cache, uint32_t classIndex) {
+    STATS_ADD(classAllocNum[classIndex], cache->allocNum[classIndex]);
+    STATS_ADD(classHitNum[classIndex], cache->hitNum[classIndex]);
+    cache->allocNum[classIndex] = 0;
+    cache->hitNum[classIndex] = 0;
+}
+
+/**
+ * @brief Registers a thread cache so it is drained when its thread exits
+ *
+ * @param cache Thread cache of the calling thread
+ */
+static void tcacheRegister(tcache_t *cache) {
+    if (tcacheKeyReady) {
+        pthread_setspecific(tcacheKey, cache);
+    }
+    cache->state = TCACHE_ACTIVE;
+}
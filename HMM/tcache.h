@@ -0,0 +1,79 @@
+#ifndef TCACHE_H  // Include guard to prevent multiple inclusions
+#define TCACHE_H
+
+#include "slab.h"  // The cache is bucketed by the slab size classes
+
+#define TCACHE_MAX_COUNT 64 // Default number of chunks kept per size class and per thread (HMM_TCACHE_COUNT)
+#define TCACHE_BATCH 32 // Number of chunks moved at once between a cache and the shared backend
+
+#define TCACHE_UNINIT 0 // The thread did not use its cache yet
+#define TCACHE_ACTIVE 1 // The cache is registered for draining at thread exit
+#define TCACHE_SHUTDOWN 2 // The cache was drained, the thread is exiting
+
+/**
+ * @brief Per-thread cache of recently freed small chunks
+ *
+ * Every bin is a singly linked list (through node_t.next) of free chunks of one slab class.
+ * Only the owning thread touches it, so neither atomics nor locks are needed.
+ */
+typedef struct tcache {
+  node_t *bin[SLAB_CLASS_NUM];       // Cached chunks of every size class
+  uint32_t count[SLAB_CLASS_NUM];    // Number of chunks in every bin
+  uint32_t allocNum[SLAB_CLASS_NUM]; // Allocations not added to the shared counters yet
+  uint32_t hitNum[SLAB_CLASS_NUM];   // Those served from the bin without a refill
+  uint32_t state;                    // TCACHE_UNINIT, TCACHE_ACTIVE or TCACHE_SHUTDOWN
+} tcache_t;
+
+/**
+ * @brief Creates the thread-specific key used to drain the caches at thread exit
+ *
+ * Called once from the library constructor. Threads that allocate before it runs
+ * simply are not drained at exit.
+ *
+ * @return Nothing
+ */
+void tcacheInit(void);
+
+/**
+ * @brief Allocates a small chunk from the calling thread cache
+ *
+ * When the bin is empty it is refilled with TCACHE_BATCH chunks taken from the slabs
+ * of the thread arena under a single acquisition of its lock.
+ *
+ * @param classIndex Size class of the requested chunk
+ *
+ * @return Pointer to the object, which is the user area, or NULL on failure
+ */
+node_t *tcacheAlloc(uint32_t classIndex);
+
+/**
+ * @brief Allocates several small chunks of one size class for hmm_malloc_batch
+ *
+ * The bin of the calling thread cache is emptied first, the rest is carved from the slabs of the
+ * thread arena with slabAllocBatch under a single acquisition of its lock, without going through
+ * the bin.
+ *
+ * @param classIndex Size class of the requested chunks
+ * @param chunks Receives the pointers to the objects
+ * @param num Number of chunks wanted
+ *
+ * @return Number of chunks allocated, less than 'num' only on failure
+ */
+size_t tcacheAllocBatch(uint32_t classIndex, void **chunks, size_t num);
+
+/**
+ * @brief Puts a freed small chunk in the calling thread cache
+ *
+ * The objects have no metadata, the caller gives the class: free reads it from the page map,
+ * the sized frees derive it from the size they were given.
+ * When the bin is full, TCACHE_BATCH chunks are flushed back to the slab spans
+ * of the arenas owning them.
+ *
+ * @param chunk Pointer to a slab object
+ * @param classIndex Size class of the object, or of a smaller size it can serve
+ *
+ * @return return_status_t indicating success (OK).
+ */
+return_status_t tcacheFree(node_t *chunk, uint32_t classIndex);
+
+#endif  // TCACHE_H
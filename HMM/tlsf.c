@@ -0,0 +1,190 @@
+/*
+ * File: tlsf.c
+ * Description: TLSF engine, a two-level segregated fit index of the free heap chunks for O(1) lookups.
+ * Author: Mohamed Eslam
+ */
+
+#include "hmm.h"
+
+static void mappingInsert(size_t size, uint32_t *fl, uint32_t *sl);
+static void mappingSearch(size_t size, uint32_t *fl, uint32_t *sl);
+
+
+/**
+ * @brief Inserts a free chunk in the index, in O(1)
+ *
+ * The chunk is pushed at the head of the list of its size class.
+ *
+ * @param index Index of the arena
+ * @param chunk Pointer to the chunk metadata, its size must not change while it is indexed
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t freeIndexInsert(free_index_t *index, node_t *chunk) {
+    return_status_t ret = OK;
+
+    if ((NULL == index) || (NULL == chunk)) {
+        ret = NULLPTR;
+    } else {
+        uint32_t fl = 0;
+        uint32_t sl = 0;
+
+        mappingInsert(CHUNK_SIZE(chunk), &fl, &sl);
+        listPushFront(&index->list[fl][sl], chunk);
+        index->flBitmap |= (uint64_t)1 << fl;
+        index->slBitmap[fl] |= (uint32_t)1 << sl;
+        index->freeNum++;
+        index->freeBytes += CHUNK_SIZE(chunk);
+    }
+    return ret;
+}
+
+/**
+ * @brief Removes a free chunk from the index, in O(1)
+ *
+ * The bits of its list are cleared when the list becomes empty.
+ *
+ * @param index Index of the arena
+ * @param chunk Pointer to the chunk metadata of an indexed chunk
+ *
+ * @return return_status_t indicating success (OK) or error (NULLPTR).
+ */
+return_status_t freeIndexRemove(free_index_t *index, node_t *chunk) {
+    return_status_t ret = OK;
+
+    if ((NULL == index) || (NULL == chunk)) {
+        ret = NULLPTR;
+    } else {
+        uint32_t fl = 0;
+        uint32_t sl = 0;
+
+        mappingInsert(CHUNK_SIZE(chunk), &fl, &sl);
+        listRemove(&index->list[fl][sl], chunk);
+        if (0 == index->list[fl][sl].count) {
+            index->slBitmap[fl] &= ~((uint32_t)1 << sl);
+            if (0 == index->slBitmap[fl]) {
+                index->flBitmap &= ~((uint64_t)1 << fl);
+            }
+        }
+        index->freeNum--;
+        index->freeBytes -= CHUNK_SIZE(chunk);
+    }
+    return ret;
+}
+
+/**
+ * @brief Finds a free chunk of at least 'size' bytes, in O(1)
+ *
+ * The size is rounded up to the next list boundary, so the head of any non-empty list from
+ * there on is large enough: this is a good fit, never a list walk. The first such list is
+ * found with the bitmaps.
+ *
+ * @param index Index of the arena
+ * @param size Requested chunk size
+ *
+ * @return A free chunk large enough, which stays in the index, or NULL if there is none
+ */
+node_t *freeIndexFind(free_index_t *index, size_t size) {
+    node_t *chunk = NULL;
+    uint32_t fl = 0;
+    uint32_t sl = 0;
+    uint32_t slMap = 0;
+
+    mappingSearch(size, &fl, &sl);
+    slMap = index->slBitmap[fl] & (~(uint32_t)0 << sl);
+    if (0 == slMap) {
+        // No list left in this class, take the first non-empty larger class
+        uint64_t flMap = index->flBitmap & (~(uint64_t)0 << (fl + 1));
+        if (0 != flMap) {
+            fl = __builtin_ctzll(flMap);
+            slMap = index->slBitmap[fl];
+        }
+    }
+    if (0 != slMap) {
+        chunk = index->list[fl][__builtin_ctz(slMap)].head;
+    }
+    return chunk;
+}
+
+/**
+ * @brief Returns the size of the largest free chunk
+ *
+ * The bitmaps give the highest non-empty list, only that list is scanned since its chunks
+ * are not sorted.
+ *
+ * @param index Index of the arena
+ *
+ * @return Size of the largest indexed chunk in bytes, 0 if there is none
+ */
+size_t freeIndexLargest(free_index_t *index) {
+    size_t size = 0;
+
+    if (0 != index->flBitmap) {
+        uint32_t fl = 63 - __builtin_clzll(index->flBitmap);
+        uint32_t sl = 31 - __builtin_clz(index->slBitmap[fl]);
+
+        for (node_t *chunk = index->list[fl][sl].head; NULL != chunk; chunk = chunk->next) {
+            if (CHUNK_SIZE(chunk) > size) {
+                size = CHUNK_SIZE(chunk);
+            }
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Calls a function on every chunk of every non-empty list
+ *
+ * @param index Index of the arena
+ * @param visit Function called with every chunk, it must not change the index
+ * @param arg Passed to 'visit'
+ *
+ * @return Nothing
+ */
+void freeIndexWalk(free_index_t *index, void (*visit)(node_t *chunk, void *arg), void *arg) {
+    for (uint64_t flMap = index->flBitmap; 0 != flMap; flMap &= flMap - 1) {
+        uint32_t fl = __builtin_ctzll(flMap);
+
+        for (uint32_t slMap = index->slBitmap[fl]; 0 != slMap; slMap &= slMap - 1) {
+            for (node_t *chunk = index->list[fl][__builtin_ctz(slMap)].head; NULL != chunk; chunk = chunk->next) {
+                visit(chunk, arg);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Computes the list of a chunk size
+ *
+ * Sizes below 1 << TLSF_FL_SHIFT are split linearly in the first class, larger sizes take
+ * their most significant bit as first level and the TLSF_SL_LOG2 bits after it as second level.
+ *
+ * @param size Chunk size
+ * @param fl Output first-level index
+ * @param sl Output second-level index
+ */
+static void mappingInsert(size_t size, uint32_t *fl, uint32_t *sl) {
+    if (size < ((size_t)1 << TLSF_FL_SHIFT)) {
+        *fl = 0;
+        *sl = (uint32_t)(size >> TLSF_ALIGN_LOG2);
+    } else {
+        uint32_t msb = 63 - __builtin_clzll(size);
+        *sl = (uint32_t)(size >> (msb - TLSF_SL_LOG2)) - TLSF_SL_NUM;
+        *fl = msb - TLSF_FL_SHIFT + 1;
+    }
+}
+
+/**
+ * @brief Computes the first list whose chunks are all large enough for a size
+ *
+ * @param size Requested chunk size
+ * @param fl Output first-level index
+ * @param sl Output second-level index
+ */
+static void mappingSearch(size_t size, uint32_t *fl, uint32_t *sl) {
+    if (size >= ((size_t)1 << TLSF_FL_SHIFT)) {
+        uint32_t msb = 63 - __builtin_clzll(size);
+        size += ((size_t)1 << (msb - TLSF_SL_LOG2)) - 1; // Round up to the next list boundary
+    }
+    mappingInsert(size, fl, sl);
+}
@@ -0,0 +1,29 @@
+#ifndef TLSF_H  // Include guard to prevent multiple inclusions
+#define TLSF_H
+
+#include "./../DoubleLinkedList/DoubleLinkedList.h"  // node_t links the free chunks of a list
+
+#define FREE_INDEX_MIN_CHUNK 32 // Smallest chunk holding its metadata, the list links and a footer
+#define TLSF_SL_LOG2 4 // log2 of the number of second-level lists per power of two
+#define TLSF_SL_NUM (1 << TLSF_SL_LOG2) // Second-level lists per first-level class
+#define TLSF_ALIGN_LOG2 4 // Chunk sizes are multiples of 16
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2) // Sizes below 1 << TLSF_FL_SHIFT share the first class
+#define TLSF_FL_NUM (64 - TLSF_FL_SHIFT + 1) // First-level classes covering any 64-bit size
+
+/**
+ * @brief Free chunk index of the TLSF engine
+ *
+ * Free chunks are kept in segregated doubly linked lists: the first level splits the sizes
+ * by powers of two, the second level splits every power of two linearly in TLSF_SL_NUM lists.
+ * One bit per list tells whether it is empty, so the lookup is a couple of find-first-set
+ * instructions and never walks a list.
+ */
+typedef struct free_index {
+  uint64_t flBitmap;                          // Bit 'fl' set when slBitmap[fl] is not empty
+  uint32_t slBitmap[TLSF_FL_NUM];             // Bit 'sl' set when list[fl][sl] is not empty
+  list_t list[TLSF_FL_NUM][TLSF_SL_NUM];      // Free lists, linked through node_t.next/prev
+  size_t freeNum;                             // Number of indexed chunks
+  size_t freeBytes;                           // Total size of the indexed chunks
+} free_index_t;
+
+#endif  // TLSF_H
@@ -0,0 +1,168 @@
+/*
+ * File: trace.c
+ * Description: recorder of the malloc/free/realloc calls, appending compact binary records to the
+ *              file named by HMM_TRACE_FILE, to be replayed offline by bench/replay.
+ * Author: Mohamed Eslam
+ */
+
+#include <fcntl.h> // For open
+#include <stdlib.h> // For getenv and atexit
+#include <sys/mman.h> // For mmap
+#include "hmm.h"
+
+/**
+ * @brief Records of one thread not written yet
+ */
+typedef struct trace_buffer {
+  uint32_t count;                                 // Records in the buffer
+  uint32_t thread;                                // Number of the owning thread
+  trace_record_t record[TRACE_BUFFER_RECORDS];    // The records, in call order
+} trace_buffer_t;
+
+static trace_buffer_t *traceBufferGet(void);
+static void traceFlush(trace_buffer_t *buffer);
+static void traceThreadExit(void *arg);
+static void traceProcessExit(void);
+static void traceForkChild(void);
+
+uint8_t traceOn = 0; // Set by traceInit when HMM_TRACE_FILE is set and could be opened
+static int traceFd = -1; // The trace file, opened in append mode
+static uint32_t traceThreadNum = 0; // Numbers given to the recording threads
+static pthread_key_t traceKey; // Its destructor flushes the buffer of an exiting thread
+static __thread trace_buffer_t *threadTrace __attribute__((tls_model("initial-exec"))); // Buffer of the calling thread
+static __thread uint8_t traceUnbuffered __attribute__((tls_model("initial-exec"))); // Set once the buffer was flushed for good
+
+
+/**
+ * @brief Starts recording when HMM_TRACE_FILE is set, called once from the library constructor
+ *
+ * The file is truncated and starts with a trace_header_t. Every thread then appends whole
+ * buffers with O_APPEND, so the records of concurrent threads never overwrite each other.
+ *
+ * @return Nothing
+ */
+void traceInit(void) {
+    const char *file = getenv(TRACE_FILE_ENV);
+
+    if ((NULL != file) && ('\0' != file[0])) {
+        traceFd = open(file, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    }
+    if (traceFd >= 0) {
+        trace_header_t header = {TRACE_MAGIC, sizeof(trace_record_t), (uint32_t)getpid()};
+
+        if ((sizeof(header) == write(traceFd, &header, sizeof(header))) &&
+            (0 == pthread_key_create(&traceKey, traceThreadExit))) {
+            atexit(traceProcessExit);
+            pthread_atfork(NULL, NULL, traceForkChild);
+            traceOn = 1;
+        }
+    }
+}
+
+/**
+ * @brief Appends a call to the buffer of the calling thread
+ *
+ * The buffer is written to the file when it is full, when its thread exits and at exit.
+ * Calls made after that (by later thread-specific destructors or atexit handlers) are written
+ * one by one. Nothing here allocates, the buffers are mapped.
+ *
+ * @param op Operation, one of the TRACE_* operations
+ * @param size Requested size
+ * @param ptr Block returned or freed
+ * @param oldPtr Block resized by realloc, or alignment
+ *
+ * @return Nothing
+ */
+void traceRecord(uint32_t op, size_t size, void *ptr, uintptr_t oldPtr) {
+    trace_buffer_t *buffer = threadTrace;
+    trace_record_t *record = NULL;
+    trace_record_t single;
+    struct timespec ts;
+
+    if ((NULL == buffer) && !traceUnbuffered) {
+        buffer = traceBufferGet();
+    }
+    record = (NULL == buffer) ? &single : &buffer->record[buffer->count];
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    record->time = (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+    record->size = size;
+    record->ptr = (uintptr_t)ptr;
+    record->oldPtr = oldPtr;
+    record->thread = (NULL == buffer) ? UINT32_MAX : buffer->thread;
+    record->op = op;
+    if (NULL == buffer) {
+        write(traceFd, &single, sizeof(single));
+    } else if (++buffer->count == TRACE_BUFFER_RECORDS) {
+        traceFlush(buffer);
+    }
+}
+
+/**
+ * @brief Maps the buffer of the calling thread and registers it for the flush at thread exit
+ *
+ * @return The buffer, or NULL if mmap failed (the records are then written one by one)
+ */
+static trace_buffer_t *traceBufferGet(void) {
+    trace_buffer_t *buffer = mmap(NULL, sizeof(trace_buffer_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (MAP_FAILED == buffer) {
+        buffer = NULL;
+    } else {
+        buffer->thread = __atomic_fetch_add(&traceThreadNum, 1, __ATOMIC_RELAXED);
+        threadTrace = buffer;
+        pthread_setspecific(traceKey, buffer);
+    }
+    return buffer;
+}
+
+/**
+ * @brief Appends the records of a buffer to the trace file and empties it
+ *
+ * @param buffer Buffer of the calling thread
+ */
+static void traceFlush(trace_buffer_t *buffer) {
+    if (0 != buffer->count) {
+        write(traceFd, buffer->record, buffer->count * sizeof(trace_record_t));
+        buffer->count = 0;
+    }
+}
+
+/**
+ * @brief Destructor of traceKey, flushes and unmaps the buffer of an exiting thread
+ *
+ * @param arg Buffer registered with pthread_setspecific
+ */
+static void traceThreadExit(void *arg) {
+    trace_buffer_t *buffer = (trace_buffer_t *)arg;
+
+    traceFlush(buffer);
+    threadTrace = NULL;
+    traceUnbuffered = 1;
+    munmap(buffer, sizeof(trace_buffer_t));
+}
+
+/**
+ * @brief atexit handler flushing the buffer of the exiting thread
+ *
+ * The buffers of threads still running at exit are not flushed, their last calls are lost.
+ */
+static void traceProcessExit(void) {
+    trace_buffer_t *buffer = threadTrace;
+
+    if (NULL != buffer) {
+        traceFlush(buffer);
+        threadTrace = NULL;
+        traceUnbuffered = 1; // The buffer stays mapped, its key destructor never runs
+    }
+}
+
+/**
+ * @brief Drops the records the child inherited from the forking thread, the parent writes them
+ *
+ * The child keeps appending to the same file.
+ */
+static void traceForkChild(void) {
+    if (NULL != threadTrace) {
+        threadTrace->count = 0;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef TRACE_H  // Include guard to prevent multiple inclusions
+#define TRACE_H
+
+#include <stdint.h>  // For the fixed-size record fields
+#include <stddef.h>  // For size_t
+
+#define TRACE_FILE_ENV "HMM_TRACE_FILE" // Recording is on when this names the trace file
+#define TRACE_MAGIC 0x31454341525448ULL // "HTRACE1", first word of every trace file
+#define TRACE_BUFFER_RECORDS 1024 // Records buffered per thread before they are appended to the file
+
+#define TRACE_MALLOC 0 // malloc, size requested, ptr returned
+#define TRACE_FREE 1 // free, ptr freed
+#define TRACE_REALLOC 2 // realloc, oldPtr resized to size, ptr returned (NULL when freed or failed)
+#define TRACE_CALLOC 3 // calloc, size is nmemb * size, ptr returned
+#define TRACE_MEMALIGN 4 // Aligned family, oldPtr holds the alignment, ptr returned
+
+// Appends a call to the trace when recording, a single predicted branch otherwise
+#define TRACE_RECORD(op, size, ptr, oldPtr) \
+    do { if (__builtin_expect(traceOn, 0)) { traceRecord((op), (size), (ptr), (oldPtr)); } } while (0)
+
+/**
+ * @brief Header written once at the beginning of a trace file
+ */
+typedef struct trace_header {
+  uint64_t magic;          // TRACE_MAGIC
+  uint32_t recordSize;     // sizeof(trace_record_t)
+  uint32_t pid;            // Process that wrote the trace
+} trace_header_t;
+
+/**
+ * @brief One call of the trace
+ *
+ * Pointers are the addresses of the blocks, which identify a block as long as it is live.
+ * Allocations are stamped when they return and frees when they start, so a block reused by
+ * another thread is always freed before it is allocated again in time order.
+ */
+typedef struct trace_record {
+  uint64_t time;           // Nanoseconds of the monotonic clock
+  uint64_t size;           // Requested size, 0 for free
+  uint64_t ptr;            // Block returned, or freed by free
+  uint64_t oldPtr;         // Block resized by realloc, alignment of the aligned family
+  uint32_t thread;         // Number of the calling thread, in the order threads first recorded
+  uint32_t op;             // TRACE_MALLOC, TRACE_FREE, TRACE_REALLOC, TRACE_CALLOC or TRACE_MEMALIGN
+} trace_record_t;
+
+extern uint8_t traceOn; // Set by traceInit when HMM_TRACE_FILE is set and could be opened
+
+/**
+ * @brief Starts recording when HMM_TRACE_FILE is set, called once from the library constructor
+ *
+ * @return Nothing
+ */
+void traceInit(void);
+
+/**
+ * @brief Appends a call to the buffer of the calling thread
+ *
+ * @param op Operation, one of the TRACE_* operations
+ * @param size Requested size
+ * @param ptr Block returned or freed
+ * @param oldPtr Block resized by realloc, or alignment
+ *
+ * @return Nothing
+ */
+void traceRecord(uint32_t op, size_t size, void *ptr, uintptr_t oldPtr);
+
+#endif  // TRACE_H
@@ -0,0 +1,198 @@
+/*
+ * File: tunables.c
+ * Description: runtime settings of the heap manager, read from the HMM_* environment variables
+ *              at startup and changed with mallopt.
+ * Author: Mohamed Eslam
+ */
+
+#include <stdlib.h> // For getenv and strtoull
+#include "hmm.h"
+
+static int tuneSet(int param, size_t value);
+static uint8_t tuneParse(const char *name, size_t *value);
+
+hmm_tunables_t hmmTunables = {SBRK_ALLOC_SIZE, MIN_FREE_SBRK, TCACHE_MAX_COUNT, ARENA_MAX_NUM, DECAY_MS_DEFAULT, 0, 0, 0};
+
+
+/**
+ * @brief Reads the HMM_* environment variables, called once from the library constructor
+ *
+ * HMM_GROW_SIZE, HMM_TRIM_THRESHOLD, HMM_MMAP_THRESHOLD, HMM_TCACHE_COUNT, HMM_ARENA_MAX,
+ * HMM_DIRTY_DECAY_MS, HMM_BACKGROUND_THREAD, HMM_PROF_SAMPLE and HMM_THP take a number, sizes
+ * accept a k, m or g suffix.
+ * Invalid values are ignored.
+ *
+ * @return Nothing
+ */
+void tuneInit(void) {
+    size_t value = 0;
+
+    if (tuneParse("HMM_GROW_SIZE", &value)) {
+        tuneSet(M_TOP_PAD, value);
+    }
+    if (tuneParse("HMM_TRIM_THRESHOLD", &value)) {
+        tuneSet(M_TRIM_THRESHOLD, value);
+    }
+    if (tuneParse("HMM_MMAP_THRESHOLD", &value)) {
+        tuneSet(M_MMAP_THRESHOLD, value);
+    }
+    if (tuneParse("HMM_TCACHE_COUNT", &value)) {
+        tuneSet(M_HMM_TCACHE_COUNT, value);
+    }
+    if (tuneParse("HMM_ARENA_MAX", &value)) {
+        tuneSet(M_ARENA_MAX, value);
+    }
+    if (tuneParse("HMM_DIRTY_DECAY_MS", &value)) {
+        tuneSet(M_HMM_DIRTY_DECAY_MS, value);
+    }
+    if (tuneParse("HMM_BACKGROUND_THREAD", &value)) {
+        tuneSet(M_HMM_BACKGROUND_THREAD, value);
+    }
+    if (tuneParse("HMM_PROF_SAMPLE", &value)) {
+        tuneSet(M_HMM_PROF_SAMPLE, value);
+    }
+    if (tuneParse("HMM_THP", &value)) {
+        tuneSet(M_HMM_THP, value);
+    }
+}
+
+/**
+ * @brief Changes a setting of the heap manager (glibc interface)
+ *
+ * M_TOP_PAD sets the heap growth step (TUNE_GROW_MIN to TUNE_GROW_MAX, rounded up to a page),
+ * M_TRIM_THRESHOLD the size of the free memory at the top of a heap from which it is given back,
+ * M_MMAP_THRESHOLD the size from which a block gets a mapping of its own (at most
+ * MMAP_THRESHOLD_MAX), M_ARENA_MAX the number of arenas new threads are spread on,
+ * M_HMM_TCACHE_COUNT the depth of the thread caches (1 to TUNE_TCACHE_MAX),
+ * M_HMM_DIRTY_DECAY_MS the decay time of the free dirty pages (0 to DECAY_MS_MAX, 0 purges them
+ * when they are freed, above the trim threshold) and M_HMM_BACKGROUND_THREAD whether a thread
+ * purges them (0 or 1, it starts with the next heap free) rather than the heap frees.
+ * M_HMM_PROF_SAMPLE turns the heap profiler on with a mean of that many bytes between two
+ * sampled allocations (1 to PROF_SAMPLE_MAX, 512 KiB is a good start) or off with 0; the
+ * blocks already sampled stay in the profile until they are freed.
+ * M_HMM_THP 1 turns the THP mode on: the heaps grow from huge page boundaries by whole huge
+ * pages advised with MADV_HUGEPAGE, and are shrunk and purged by whole huge pages only. It cannot
+ * be turned off again, the buddy engine keeps the first huge page of a purged block resident
+ * and relies on it.
+ * The other glibc settings are not supported.
+ *
+ * @param param Setting to change
+ * @param value New value
+ *
+ * @return 1 on success, 0 for an unknown setting or an invalid value
+ */
+int mallopt(int param, int value) {
+    int ret = 0;
+
+    if (value >= 0) {
+        ret = tuneSet(param, (size_t)value);
+    }
+    return ret;
+}
+
+/**
+ * @brief Checks and stores a setting
+ *
+ * @param param Setting to change, one of the mallopt parameters
+ * @param value New value
+ *
+ * @return 1 on success, 0 for an unknown setting or an invalid value
+ */
+static int tuneSet(int param, size_t value) {
+    int ret = 1;
+    size_t pageSize = getpagesize();
+
+    switch (param) {
+    case M_TOP_PAD:
+        if ((value < TUNE_GROW_MIN) || (value > TUNE_GROW_MAX)) {
+            ret = 0;
+        } else {
+            __atomic_store_n(&hmmTunables.growSize, (value + pageSize - 1) & ~(pageSize - 1), __ATOMIC_RELAXED);
+        }
+        break;
+    case M_TRIM_THRESHOLD:
+        __atomic_store_n(&hmmTunables.trimThreshold, value, __ATOMIC_RELAXED);
+        break;
+    case M_MMAP_THRESHOLD:
+        ret = (OK == mmapChunkSetThreshold(value)) ? 1 : 0;
+        break;
+    case M_HMM_TCACHE_COUNT:
+        if ((value < 1) || (value > TUNE_TCACHE_MAX)) {
+            ret = 0;
+        } else {
+            __atomic_store_n(&hmmTunables.tcacheCount, (uint32_t)value, __ATOMIC_RELAXED);
+        }
+        break;
+    case M_ARENA_MAX:
+        if ((value < 1) || (value > ARENA_MAX_NUM)) {
+            ret = 0;
+        } else {
+            __atomic_store_n(&hmmTunables.arenaMax, (uint32_t)value, __ATOMIC_RELAXED);
+            arenaResetCount(); // Threads not assigned yet are spread on the new number
+        }
+        break;
+    case M_HMM_DIRTY_DECAY_MS:
+        if (value > DECAY_MS_MAX) {
+            ret = 0;
+        } else {
+            __atomic_store_n(&hmmTunables.dirtyDecayMs, (uint64_t)value, __ATOMIC_RELAXED);
+        }
+        break;
+    case M_HMM_BACKGROUND_THREAD:
+        if (value > 1) {
+            ret = 0;
+        } else {
+            __atomic_store_n(&hmmTunables.backgroundThread, (uint32_t)value, __ATOMIC_RELAXED);
+        }
+        break;
+    case M_HMM_PROF_SAMPLE:
+        if (value > PROF_SAMPLE_MAX) {
+            ret = 0;
+        } else {
+            __atomic_store_n(&hmmTunables.profSample, value, __ATOMIC_RELAXED);
+        }
+        break;
+    case M_HMM_THP:
+        if ((value > 1) || ((0 == value) && (0 != TUNE_GET(hugePages)))) {
+            ret = 0;
+        } else {
+            __atomic_store_n(&hmmTunables.hugePages, (uint32_t)value, __ATOMIC_RELAXED);
+        }
+        break;
+    default:
+        ret = 0;
+        break;
+    }
+    return ret;
+}
+
+/**
+ * @brief Reads a number from the environment
+ *
+ * @param name Name of the variable
+ * @param value Receives the number, multiplied by 1024 per k, m or g suffix
+ *
+ * @return 1 when the variable holds a valid number, 0 otherwise
+ */
+static uint8_t tuneParse(const char *name, size_t *value) {
+    uint8_t ret = 0;
+    const char *text = getenv(name);
+
+    if ((NULL != text) && (text[0] >= '0') && (text[0] <= '9')) {
+        char *end = NULL;
+        unsigned long long number = strtoull(text, &end, 0);
+        uint32_t shift = 0;
+
+        switch (*end) {
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        default: break;
+        }
+        if (('\0' == *end) && (number <= (SIZE_MAX >> shift))) {
+            *value = (size_t)number << shift;
+            ret = 1;
+        }
+    }
+    return ret;
+}
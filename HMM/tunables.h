@@ -0,0 +1,70 @@
+#ifndef TUNABLES_H  // Include guard to prevent multiple inclusions
+#define TUNABLES_H
+
+#include <stddef.h>  // For size_t
+#include <stdint.h>  // For the fixed-size fields
+#include <malloc.h>  // For the M_* parameters of mallopt
+
+#define M_HMM_TCACHE_COUNT (-101) // mallopt parameter of the thread cache depth, not in glibc
+#define M_HMM_DIRTY_DECAY_MS (-102) // mallopt parameter of the decay time of the dirty pages, not in glibc
+#define M_HMM_BACKGROUND_THREAD (-103) // mallopt parameter turning the background purging thread on (1) or off (0)
+#define M_HMM_PROF_SAMPLE (-104) // mallopt parameter of the mean bytes between two sampled allocations, 0 turns the profiler off
+#define M_HMM_THP (-105) // mallopt parameter turning the THP mode of the arena heaps on (1), it cannot be turned off
+#define TUNE_GROW_MIN (64*1024) // Smallest heap growth step
+#define TUNE_GROW_MAX (16*1024*1024) // Largest heap growth step, a quarter of an arena region
+#define TUNE_TCACHE_MAX 1024 // Deepest thread cache bin
+#define TUNE_GET(field) __atomic_load_n(&hmmTunables.field, __ATOMIC_RELAXED) // Reads a tunable
+
+/**
+ * @brief Settings chosen at startup with the HMM_* environment variables or at runtime with mallopt
+ *
+ * Every field starts at its compile-time default and is read with TUNE_GET, a plain load, so
+ * a change made by mallopt applies to the next calls of every thread. The mmap threshold is
+ * kept by mmapchunk.c, which also adapts it unless it was set.
+ */
+typedef struct hmm_tunables {
+  size_t growSize;           // HMM_GROW_SIZE, M_TOP_PAD: the heap grows by multiples of it
+  size_t trimThreshold;      // HMM_TRIM_THRESHOLD, M_TRIM_THRESHOLD: free top chunk size given back to the OS
+  uint32_t tcacheCount;      // HMM_TCACHE_COUNT, M_HMM_TCACHE_COUNT: chunks kept per thread cache bin
+  uint32_t arenaMax;         // HMM_ARENA_MAX, M_ARENA_MAX: arenas the threads are spread on, at most
+  uint64_t dirtyDecayMs;     // HMM_DIRTY_DECAY_MS, M_HMM_DIRTY_DECAY_MS: time for the free dirty pages to be purged, 0 purges at free
+  uint32_t backgroundThread; // HMM_BACKGROUND_THREAD, M_HMM_BACKGROUND_THREAD: a thread purges them rather than the heap frees
+  size_t profSample;         // HMM_PROF_SAMPLE, M_HMM_PROF_SAMPLE: mean bytes between two sampled allocations, 0 when not profiling
+  uint32_t hugePages;        // HMM_THP, M_HMM_THP: arena heaps aligned on huge pages, advised with MADV_HUGEPAGE and purged by huge pages
+} hmm_tunables_t;
+
+extern hmm_tunables_t hmmTunables; // The current settings
+
+/**
+ * @brief Reads the HMM_* environment variables, called once from the library constructor
+ *
+ * HMM_GROW_SIZE, HMM_TRIM_THRESHOLD, HMM_MMAP_THRESHOLD, HMM_TCACHE_COUNT, HMM_ARENA_MAX,
+ * HMM_DIRTY_DECAY_MS, HMM_BACKGROUND_THREAD, HMM_PROF_SAMPLE and HMM_THP take a number, sizes
+ * accept a k, m or g suffix.
+ * Invalid values are ignored.
+ *
+ * @return Nothing
+ */
+void tuneInit(void);
+
+/**
+ * @brief Changes a setting of the heap manager (glibc interface)
+ *
+ * M_TOP_PAD sets the heap growth step (TUNE_GROW_MIN to TUNE_GROW_MAX, rounded up to a page),
+ * M_TRIM_THRESHOLD the size of the free memory at the top of a heap from which it is given back,
+ * M_MMAP_THRESHOLD the size from which a block gets a mapping of its own (at most
+ * MMAP_THRESHOLD_MAX), M_ARENA_MAX the number of arenas new threads are spread on,
+ * M_HMM_TCACHE_COUNT the depth of the thread caches (1 to TUNE_TCACHE_MAX),
+ * M_HMM_DIRTY_DECAY_MS the decay time of the free dirty pages (0 to DECAY_MS_MAX),
+ * M_HMM_BACKGROUND_THREAD whether a thread purges them (0 or 1), M_HMM_PROF_SAMPLE the mean
+ * bytes between two allocations sampled by the heap profiler (0 to PROF_SAMPLE_MAX, 0 is off)
+ * and M_HMM_THP the THP mode of the arena heaps (1 turns it on, for good).
+ *
+ * @param param Setting to change
+ * @param value New value
+ *
+ * @return 1 on success, 0 for an unknown setting or an invalid value
+ */
+int mallopt(int param, int value);
+
+#endif  // TUNABLES_H
@@ -0,0 +1,81 @@
+/*
+ * File: batch.c
+ * Description: bursts of same-sized blocks allocated and freed one by one, then with
+ *              hmm_malloc_batch/hmm_free_batch, run it with LD_PRELOAD=./libhmm.so [burst].
+ *              The blocks of a burst are freed in a random order, like the messages of a pipeline
+ *              finishing out of order. Without libhmm only the first loop runs.
+ * Author: Mohamed Eslam
+ */
+
+#define _GNU_SOURCE // For RTLD_DEFAULT
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BURST_MAX 4096 // Largest burst
+#define OBJECT_NUM (4*1000*1000) // Blocks allocated and freed per size and per loop
+
+static double nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    static void *ptrs[BURST_MAX];
+    static const size_t sizes[] = {64, 256, 1024, 4096};
+    size_t burst = (argc > 1) ? (size_t)atol(argv[1]) : 256;
+    size_t (*mallocBatch)(size_t, size_t, void **) =
+        (size_t (*)(size_t, size_t, void **))dlsym(RTLD_DEFAULT, "hmm_malloc_batch");
+    void (*freeBatch)(void **, size_t) = (void (*)(void **, size_t))dlsym(RTLD_DEFAULT, "hmm_free_batch");
+    unsigned int seed = 1;
+
+    if ((0 == burst) || (burst > BURST_MAX)) {
+        return 1;
+    }
+    printf("burst %zu     size   ns/object single   ns/object batch\n", burst);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t rounds = OBJECT_NUM / burst;
+        double single = 0;
+        double batch = 0;
+
+        double start = nowNsec();
+        for (size_t r = 0; r < rounds; r++) {
+            for (size_t i = 0; i < burst; i++) {
+                ptrs[i] = malloc(sizes[s]);
+                *(char *)ptrs[i] = (char)i;
+            }
+            for (size_t i = burst - 1; i > 0; i--) {
+                size_t j = (size_t)rand_r(&seed) % (i + 1);
+                void *tmp = ptrs[i];
+                ptrs[i] = ptrs[j];
+                ptrs[j] = tmp;
+            }
+            for (size_t i = 0; i < burst; i++) {
+                free(ptrs[i]);
+            }
+        }
+        single = (nowNsec() - start) / (rounds * burst);
+
+        if ((NULL != mallocBatch) && (NULL != freeBatch)) {
+            start = nowNsec();
+            for (size_t r = 0; r < rounds; r++) {
+                size_t num = mallocBatch(sizes[s], burst, ptrs);
+                for (size_t i = 0; i < num; i++) {
+                    *(char *)ptrs[i] = (char)i;
+                }
+                for (size_t i = num - 1; i > 0; i--) {
+                    size_t j = (size_t)rand_r(&seed) % (i + 1);
+                    void *tmp = ptrs[i];
+                    ptrs[i] = ptrs[j];
+                    ptrs[j] = tmp;
+                }
+                freeBatch(ptrs, num);
+            }
+            batch = (nowNsec() - start) / (rounds * burst);
+        }
+        printf("%17zu %19.1f %17.1f\n", sizes[s], single, batch);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * File: free_latency.c
+ * Description: free() latency as the number of free blocks grows, run it with
+ *              LD_PRELOAD=./libhmm.so. With boundary tags the time per free stays flat.
+ * Author: Mohamed Eslam
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BLOCK_SIZE 1024 // Above the slab sizes, so the blocks come from the arena heap
+#define MAX_HOLES (64*1024)
+
+static double nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void) {
+    static void *blocks[3 * MAX_HOLES];
+
+    printf("free blocks   ns/free\n");
+    for (int holes = 1024; holes <= MAX_HOLES; holes *= 2) {
+        int num = 3 * holes;
+
+        for (int i = 0; i < num; i++) {
+            blocks[i] = malloc(BLOCK_SIZE);
+        }
+        // Every third block is freed: 'holes' free blocks separated by two live ones
+        for (int i = 0; i < num; i += 3) {
+            free(blocks[i]);
+        }
+        // Timed: each free merges with one neighbouring hole, fragmentation stays 'holes'
+        double start = nowNsec();
+        for (int i = 1; i < num; i += 3) {
+            free(blocks[i]);
+        }
+        double perFree = (nowNsec() - start) / holes;
+        printf("%11d %9.1f\n", holes, perFree);
+
+        for (int i = 2; i < num; i += 3) {
+            free(blocks[i]);
+        }
+    }
+    return 0;
+}
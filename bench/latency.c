@@ -0,0 +1,92 @@
+/*
+ * File: latency.c
+ * Description: tail latency of malloc and free on the arena heap, run it with
+ *              LD_PRELOAD=./libhmm.so [ops] [pow2]. Prints the p50, p99, p99.9 and max
+ *              of both, make bench-engines runs it once per heap engine. With pow2, every
+ *              request is a power of two, the best case of the buddy engine: each one fills
+ *              its block exactly, the blocks have no metadata.
+ * Author: Mohamed Eslam
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SLOT_NUM 8192 // Live blocks at most, the heap stays fragmented
+#define MIN_SIZE 600 // Above the slab sizes, so the blocks come from the arena heap
+#define MAX_SIZE (64*1024) // Below the mmap threshold
+#define WARMUP_OPS 200000 // Untimed operations fragmenting the heap first
+
+static double nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *samples, long num) {
+    qsort(samples, num, sizeof(double), compareDouble);
+    printf("%-7s %10ld %9.0f %9.0f %9.0f %9.0f\n", name, num,
+           samples[num / 2], samples[(long)(num * 0.99)], samples[(long)(num * 0.999)], samples[num - 1]);
+}
+
+static size_t randomSize(int pow2) {
+    if (pow2) {
+        return (size_t)1024 << (rand() % 7); // 1 KiB to 64 KiB
+    }
+    // Mostly small blocks with a long tail of large ones
+    size_t range = (rand() % 8 == 0) ? (MAX_SIZE - MIN_SIZE) : 4096;
+    return MIN_SIZE + (size_t)rand() % range;
+}
+
+int main(int argc, char **argv) {
+    long ops = (argc > 1) ? atol(argv[1]) : 1000000;
+    int pow2 = (argc > 2) && (0 == strcmp(argv[2], "pow2"));
+    static void *slots[SLOT_NUM];
+    double *mallocNs = malloc(ops * sizeof(double));
+    double *freeNs = malloc(ops * sizeof(double));
+    long mallocNum = 0;
+    long freeNum = 0;
+
+    if ((NULL == mallocNs) || (NULL == freeNs)) {
+        return 1;
+    }
+    srand(1);
+    for (long i = 0; i < WARMUP_OPS + ops; i++) {
+        int slot = rand() % SLOT_NUM;
+        int timed = (i >= WARMUP_OPS);
+
+        if (NULL == slots[slot]) {
+            size_t size = randomSize(pow2);
+            double start = nowNsec();
+            slots[slot] = malloc(size);
+            double end = nowNsec();
+            if (NULL == slots[slot]) {
+                return 1;
+            }
+            *(volatile char *)slots[slot] = 1;
+            if (timed) {
+                mallocNs[mallocNum++] = end - start;
+            }
+        } else {
+            double start = nowNsec();
+            free(slots[slot]);
+            double end = nowNsec();
+            slots[slot] = NULL;
+            if (timed) {
+                freeNs[freeNum++] = end - start;
+            }
+        }
+    }
+
+    printf("op           count    p50 ns    p99 ns  p99.9 ns    max ns\n");
+    report("malloc", mallocNs, mallocNum);
+    report("free", freeNs, freeNum);
+    return 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * File: realloc.c
+ * Description: vector-style realloc growth, run it with LD_PRELOAD=./libhmm.so [buffers] [max-bytes].
+ *              Several buffers grow by 1.5x in turns and are checked after every move, then
+ *              shrink back. Reports the time and, under libhmm, how many reallocs were in place
+ *              or done with mremap.
+ * Author: Mohamed Eslam
+ */
+
+#define _GNU_SOURCE // For RTLD_DEFAULT
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../HMM/stats.h" // For hmm_stats_t
+
+static double nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    int num = (argc > 1) ? atoi(argv[1]) : 4;
+    size_t maxSize = (argc > 2) ? (size_t)atol(argv[2]) : (size_t)4 * 1024 * 1024;
+    void (*statsFn)(hmm_stats_t *) = (void (*)(hmm_stats_t *))dlsym(RTLD_DEFAULT, "hmm_stats");
+    unsigned char **bufs = calloc(num, sizeof(*bufs));
+    size_t *sizes = calloc(num, sizeof(*sizes));
+    hmm_stats_t before = {0};
+    hmm_stats_t after = {0};
+    long calls = 0;
+
+    if ((NULL == bufs) || (NULL == sizes)) {
+        return 1;
+    }
+    if (NULL != statsFn) {
+        statsFn(&before);
+    }
+    double start = nowNsec();
+    for (int i = 0; i < num; i++) {
+        sizes[i] = 16;
+        bufs[i] = malloc(sizes[i]);
+        memset(bufs[i], i, sizes[i]);
+    }
+    for (int grown = 1; grown;) {
+        grown = 0;
+        for (int i = 0; i < num; i++) {
+            if (sizes[i] < maxSize) {
+                size_t newSize = sizes[i] + sizes[i] / 2;
+                unsigned char *newBuf = realloc(bufs[i], newSize);
+                if ((NULL == newBuf) || (newBuf[0] != (unsigned char)i) || (newBuf[sizes[i] - 1] != (unsigned char)i)) {
+                    printf("realloc lost the data\n");
+                    return 1;
+                }
+                memset(newBuf + sizes[i], i, newSize - sizes[i]);
+                bufs[i] = newBuf;
+                sizes[i] = newSize;
+                calls++;
+                grown = 1;
+            }
+        }
+    }
+    for (int i = 0; i < num; i++) {
+        while (sizes[i] > 64) {
+            sizes[i] /= 2;
+            bufs[i] = realloc(bufs[i], sizes[i]);
+            if (bufs[i][sizes[i] - 1] != (unsigned char)i) {
+                printf("realloc lost the data\n");
+                return 1;
+            }
+            calls++;
+        }
+        free(bufs[i]);
+    }
+    double elapsed = nowNsec() - start;
+
+    printf("%ld reallocs in %.2f ms", calls, elapsed / 1e6);
+    if (NULL != statsFn) {
+        statsFn(&after);
+        printf(", %zu of %zu in place, %zu with mremap", after.reallocInPlaceNum - before.reallocInPlaceNum,
+               after.reallocNum - before.reallocNum, after.reallocRemapNum - before.reallocRemapNum);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * File: replay.c
+ * Description: offline replay of a trace recorded with HMM_TRACE_FILE=<file> LD_PRELOAD=./libhmm.so,
+ *              run it as [LD_PRELOAD=./bench/libhmm-<engine>.so] ./bench/replay <file>. The calls
+ *              of every thread are replayed in time order on a single thread, every page of a
+ *              block being touched, and the time, the peak RSS growth and the fragmentation (that
+ *              growth divided by the peak of the live requested bytes) are reported. Without
+ *              LD_PRELOAD it measures the glibc malloc on the same trace.
+ * Author: Mohamed Eslam
+ */
+
+#define _GNU_SOURCE // For MAP_ANONYMOUS
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../HMM/trace.h" // For the trace format
+
+#define PAGE 4096 // Every page of a block is touched, so its memory counts in the RSS
+#define NO_SLOT UINT64_MAX // Record skipped, or realloc of NULL
+#define EMPTY_KEY 0 // Free entry of the address table, NULL is never live
+
+/**
+ * @brief Entry of the table mapping the address of a live block to its slot
+ */
+typedef struct address_entry {
+  uint64_t address;        // Address of the block in the recorded process
+  uint64_t slot;           // Slot of the block in the replay
+} address_entry_t;
+
+static address_entry_t *addressTable; // Open addressing with linear probing
+static uint64_t addressMask; // Number of entries minus one, a power of two minus one
+
+/**
+ * @brief Maps memory the replay itself needs, never taken from the allocator being measured
+ */
+static void *mapZeroed(size_t size) {
+    void *ptr = mmap(NULL, (size > 0) ? size : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (MAP_FAILED == ptr) {
+        perror("mmap");
+        exit(1);
+    }
+    memset(ptr, 0, size); // Committed now, before the RSS baseline is taken
+    return ptr;
+}
+
+static double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Reads a field of /proc/self/status, in KiB
+ */
+static long statusKb(const char *field) {
+    char line[128];
+    long kb = 0;
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (NULL != status) {
+        while (NULL != fgets(line, sizeof(line), status)) {
+            if (0 == strncmp(line, field, strlen(field))) {
+                kb = atol(line + strlen(field) + 1);
+            }
+        }
+        fclose(status);
+    }
+    return kb;
+}
+
+/**
+ * @brief Resets the peak RSS to the current RSS, so the loading and sorting of the trace do not count
+ */
+static void resetPeakRss(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+
+    if ((fd < 0) || (1 != write(fd, "5", 1))) {
+        printf("cannot reset the peak RSS, it includes the loading of the trace\n");
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+static uint64_t addressHash(uint64_t address) {
+    return ((address >> 4) * 0x9E3779B97F4A7C15ULL) & addressMask;
+}
+
+static uint64_t addressFind(uint64_t address) {
+    uint64_t i = addressHash(address);
+
+    while ((EMPTY_KEY != addressTable[i].address) && (address != addressTable[i].address)) {
+        i = (i + 1) & addressMask;
+    }
+    return i;
+}
+
+/**
+ * @brief Removes an entry, shifting back the entries of its probe sequence
+ */
+static void addressRemove(uint64_t i) {
+    uint64_t j = i;
+
+    addressTable[i].address = EMPTY_KEY;
+    for (;;) {
+        j = (j + 1) & addressMask;
+        if (EMPTY_KEY == addressTable[j].address) {
+            break;
+        }
+        uint64_t home = addressHash(addressTable[j].address);
+        // Move j to the hole unless its home lies cyclically in ]i, j]
+        if (((j > i) && ((home <= i) || (home > j))) || ((j < i) && ((home <= i) && (home > j)))) {
+            addressTable[i] = addressTable[j];
+            addressTable[j].address = EMPTY_KEY;
+            i = j;
+        }
+    }
+}
+
+/**
+ * @brief Sorts the records by time, keeping the file order of equal times (the call order of a thread)
+ */
+static void sortRecords(trace_record_t *records, uint64_t num) {
+    trace_record_t *tmp = mapZeroed(num * sizeof(trace_record_t));
+
+    for (uint64_t width = 1; width < num; width *= 2) {
+        for (uint64_t lo = 0; lo < num; lo += 2 * width) {
+            uint64_t mid = (lo + width < num) ? lo + width : num;
+            uint64_t hi = (lo + 2 * width < num) ? lo + 2 * width : num;
+            uint64_t a = lo, b = mid, k = lo;
+
+            while ((a < mid) && (b < hi)) {
+                tmp[k++] = (records[b].time < records[a].time) ? records[b++] : records[a++];
+            }
+            while (a < mid) {
+                tmp[k++] = records[a++];
+            }
+            while (b < hi) {
+                tmp[k++] = records[b++];
+            }
+        }
+        memcpy(records, tmp, num * sizeof(trace_record_t));
+    }
+    munmap(tmp, num * sizeof(trace_record_t));
+}
+
+/**
+ * @brief Turns the addresses of the records into slots, numbers reused once their block is freed
+ *
+ * ptr becomes the slot of the block allocated or freed, oldPtr the slot resized by realloc.
+ * Records that cannot be replayed (failed calls, frees of blocks allocated before the trace
+ * started, allocations racing with the free of the same address on another thread) get NO_SLOT.
+ *
+ * @return Number of slots needed
+ */
+static uint64_t assignSlots(trace_record_t *records, uint64_t num, uint64_t *skipped) {
+    uint64_t *freeSlots = mapZeroed(num * sizeof(uint64_t));
+    uint64_t freeNum = 0;
+    uint64_t slotNum = 0;
+
+    for (uint64_t n = 0; n < num; n++) {
+        trace_record_t *record = &records[n];
+        uint64_t oldSlot = NO_SLOT;
+
+        if ((TRACE_FREE == record->op) || (TRACE_REALLOC == record->op)) {
+            uint64_t address = (TRACE_FREE == record->op) ? record->ptr : record->oldPtr;
+            uint64_t i = addressFind(address);
+            if ((EMPTY_KEY != address) && (EMPTY_KEY != addressTable[i].address)) {
+                oldSlot = addressTable[i].slot;
+                addressRemove(i);
+            } else if (EMPTY_KEY != address) {
+                record->op = UINT32_MAX; // Block unknown to the trace
+                (*skipped)++;
+                continue;
+            }
+        }
+        if (TRACE_FREE == record->op) {
+            record->ptr = oldSlot;
+            if (NO_SLOT != oldSlot) {
+                freeSlots[freeNum++] = oldSlot;
+            }
+        } else if ((0 == record->ptr) || (EMPTY_KEY != addressTable[addressFind(record->ptr)].address)) {
+            // Failed call, realloc(ptr, 0), or a race: the block stays where it was
+            if ((TRACE_REALLOC == record->op) && (NO_SLOT != oldSlot)) {
+                if ((0 == record->size) && (0 == record->ptr)) {
+                    record->op = TRACE_FREE; // realloc(ptr, 0) freed the block
+                    record->ptr = oldSlot;
+                    freeSlots[freeNum++] = oldSlot;
+                    continue;
+                }
+                addressTable[addressFind(record->oldPtr)] = (address_entry_t){record->oldPtr, oldSlot};
+            }
+            record->op = UINT32_MAX;
+            (*skipped)++;
+        } else {
+            uint64_t slot = oldSlot;
+            if (NO_SLOT == slot) {
+                slot = (freeNum > 0) ? freeSlots[--freeNum] : slotNum++;
+            }
+            addressTable[addressFind(record->ptr)] = (address_entry_t){record->ptr, slot};
+            if (TRACE_REALLOC == record->op) {
+                record->oldPtr = oldSlot;
+            }
+            record->ptr = slot;
+        }
+    }
+    munmap(freeSlots, num * sizeof(uint64_t));
+    return slotNum;
+}
+
+static void touch(char *ptr, size_t from, size_t to) {
+    for (size_t off = from; off < to; off += PAGE) {
+        ptr[off] = 1;
+    }
+}
+
+int main(int argc, char **argv) {
+    int fd = (argc > 1) ? open(argv[1], O_RDONLY) : -1;
+    struct stat st;
+    trace_header_t *header = NULL;
+    trace_record_t *records = NULL;
+    uint64_t num = 0, skipped = 0, slotNum = 0, failed = 0;
+    char **blocks = NULL;
+    size_t *sizes = NULL;
+    long live = 0, peakLive = 0, baseKb = 0, peakKb = 0;
+
+    if ((fd < 0) || (0 != fstat(fd, &st)) || ((size_t)st.st_size < sizeof(trace_header_t))) {
+        printf("%s <trace recorded with %s=<file>>\n", argv[0], TRACE_FILE_ENV);
+        return 1;
+    }
+    header = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if ((MAP_FAILED == header) || (TRACE_MAGIC != header->magic) || (sizeof(trace_record_t) != header->recordSize)) {
+        printf("%s is not a trace of this version\n", argv[1]);
+        return 1;
+    }
+    records = (trace_record_t *)(header + 1);
+    num = (st.st_size - sizeof(trace_header_t)) / sizeof(trace_record_t);
+    addressMask = 1;
+    while (addressMask < 2 * num) {
+        addressMask *= 2;
+    }
+    addressTable = mapZeroed(addressMask * sizeof(address_entry_t));
+    addressMask--;
+
+    sortRecords(records, num);
+    slotNum = assignSlots(records, num, &skipped);
+    munmap(addressTable, (addressMask + 1) * sizeof(address_entry_t));
+    blocks = mapZeroed(slotNum * sizeof(char *));
+    sizes = mapZeroed(slotNum * sizeof(size_t));
+
+    resetPeakRss();
+    baseKb = statusKb("VmRSS");
+    double start = nowSec();
+    for (uint64_t n = 0; n < num; n++) {
+        trace_record_t *record = &records[n];
+        char *ptr = NULL;
+
+        switch (record->op) {
+        case TRACE_MALLOC:
+            ptr = malloc(record->size);
+            break;
+        case TRACE_CALLOC:
+            ptr = calloc(1, record->size);
+            break;
+        case TRACE_MEMALIGN:
+            if (0 != posix_memalign((void **)&ptr, (record->oldPtr < sizeof(void *)) ? sizeof(void *) : record->oldPtr, record->size)) {
+                ptr = NULL;
+            }
+            break;
+        case TRACE_FREE:
+            if (NO_SLOT != record->ptr) {
+                free(blocks[record->ptr]);
+                live -= sizes[record->ptr];
+                blocks[record->ptr] = NULL;
+            } else {
+                free(NULL);
+            }
+            continue;
+        case TRACE_REALLOC:
+            if (NO_SLOT == record->oldPtr) {
+                ptr = realloc(NULL, record->size);
+            } else {
+                ptr = realloc(blocks[record->oldPtr], record->size);
+                if (NULL != ptr) {
+                    live -= sizes[record->oldPtr];
+                    blocks[record->oldPtr] = NULL;
+                }
+            }
+            break;
+        default:
+            continue; // Skipped record
+        }
+        if (NULL == ptr) {
+            failed++;
+        } else {
+            size_t oldSize = (TRACE_REALLOC == record->op) && (NO_SLOT != record->oldPtr) ? sizes[record->ptr] : 0;
+            touch(ptr, oldSize, record->size);
+            blocks[record->ptr] = ptr;
+            sizes[record->ptr] = record->size;
+            live += record->size;
+            if (live > peakLive) {
+                peakLive = live;
+            }
+        }
+    }
+    double secs = nowSec() - start;
+    peakKb = statusKb("VmHWM");
+
+    printf("records        %12llu (%llu skipped, %llu failed)\n", (unsigned long long)num,
+           (unsigned long long)skipped, (unsigned long long)failed);
+    printf("time           %12.3f s (%.0f calls/sec)\n", secs, (num - skipped) / secs);
+    printf("peak live      %12.1f MiB\n", peakLive / 1048576.0);
+    printf("peak RSS       %12.1f MiB above the replay baseline\n", (peakKb - baseKb) / 1024.0);
+    printf("fragmentation  %12.2f\n", (peakLive > 0) ? (peakKb - baseKb) * 1024.0 / peakLive : 0);
+    return 0;
+}
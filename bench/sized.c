@@ -0,0 +1,75 @@
+/*
+ * File: sized.c
+ * Description: many small blocks allocated, then freed in a random order with free() and with
+ *              free_sized(), run it with LD_PRELOAD=./libhmm.so [blocks]. The blocks outnumber
+ *              the cache lines of the last level cache, so the metadata free() reads is cold.
+ *              Without libhmm only the first loop runs.
+ * Author: Mohamed Eslam
+ */
+
+#define _GNU_SOURCE // For RTLD_DEFAULT
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BLOCK_NUM (4*1000*1000) // Blocks allocated and freed per size and per loop
+#define ROUND_NUM 4 // Rounds per loop
+
+static double nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Allocates every block and shuffles them, the order in which they are freed
+static void fill(void **ptrs, size_t num, size_t size, unsigned int *seed) {
+    for (size_t i = 0; i < num; i++) {
+        ptrs[i] = malloc(size);
+        *(char *)ptrs[i] = (char)i;
+    }
+    for (size_t i = num - 1; i > 0; i--) {
+        size_t j = (size_t)rand_r(seed) % (i + 1);
+        void *tmp = ptrs[i];
+        ptrs[i] = ptrs[j];
+        ptrs[j] = tmp;
+    }
+}
+
+int main(int argc, char **argv) {
+    static const size_t sizes[] = {16, 64, 256};
+    size_t num = (argc > 1) ? (size_t)atol(argv[1]) : BLOCK_NUM;
+    void **ptrs = malloc(num * sizeof(void *));
+    void (*freeSized)(void *, size_t) = (void (*)(void *, size_t))dlsym(RTLD_DEFAULT, "free_sized");
+    unsigned int seed = 1;
+
+    if ((0 == num) || (NULL == ptrs)) {
+        return 1;
+    }
+    printf("blocks %zu    size   ns/free free   ns/free free_sized\n", num);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        double plain = 0;
+        double sized = 0;
+
+        for (int r = 0; r < ROUND_NUM; r++) {
+            fill(ptrs, num, sizes[s], &seed);
+            double start = nowNsec();
+            for (size_t i = 0; i < num; i++) {
+                free(ptrs[i]);
+            }
+            plain += nowNsec() - start;
+
+            if (NULL != freeSized) {
+                fill(ptrs, num, sizes[s], &seed);
+                start = nowNsec();
+                for (size_t i = 0; i < num; i++) {
+                    freeSized(ptrs[i], sizes[s]);
+                }
+                sized += nowNsec() - start;
+            }
+        }
+        printf("%19zu %14.1f %20.1f\n", sizes[s], plain / (ROUND_NUM * num), sized / (ROUND_NUM * num));
+    }
+    free(ptrs);
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * File: small.c
+ * Description: footprint of many small objects, the RSS grown per object and the time of a
+ *              malloc/free pair for each size, run it with LD_PRELOAD=./libhmm.so [objects].
+ * Author: Mohamed Eslam
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define OBJECT_NUM (4*1000*1000) // Objects kept live per size
+
+static double nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Resident set size of the process in bytes
+static long rssBytes(void) {
+    char line[128];
+    long kiloBytes = 0;
+    FILE *file = fopen("/proc/self/status", "r");
+
+    if (NULL != file) {
+        while (NULL != fgets(line, sizeof(line), file)) {
+            if (1 == sscanf(line, "VmRSS: %ld kB", &kiloBytes)) {
+                break;
+            }
+        }
+        fclose(file);
+    }
+    return kiloBytes * 1024;
+}
+
+int main(int argc, char **argv) {
+    static const size_t sizes[] = {8, 16, 24, 32, 48, 64};
+    size_t num = (argc > 1) ? (size_t)atol(argv[1]) : OBJECT_NUM;
+    void **ptrs = malloc(num * sizeof(void *));
+
+    if ((0 == num) || (NULL == ptrs)) {
+        return 1;
+    }
+    for (size_t i = 0; i < num; i++) {
+        ptrs[i] = NULL; // Faulted in now, so its pages are not counted with the objects
+    }
+    printf("objects %zu   size   rss bytes/object   ns/malloc+free\n", num);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        long rss = rssBytes();
+
+        for (size_t i = 0; i < num; i++) {
+            ptrs[i] = malloc(sizes[s]);
+            *(char *)ptrs[i] = (char)i;
+        }
+        double perObject = (double)(rssBytes() - rss) / num;
+
+        double start = nowNsec();
+        for (size_t i = 0; i < num; i++) {
+            free(ptrs[i]);
+            ptrs[i] = malloc(sizes[s]);
+        }
+        double perPair = (nowNsec() - start) / num;
+
+        for (size_t i = 0; i < num; i++) {
+            free(ptrs[i]);
+        }
+        printf("%20zu %18.1f %16.1f\n", sizes[s], perObject, perPair);
+    }
+    free(ptrs);
+    return 0;
+}
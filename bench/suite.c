@@ -0,0 +1,412 @@
+/*
+ * File: suite.c
+ * Description: allocator benchmark suite, ./bench/suite [library] [scale]. Every workload runs
+ *              in a child process once with the glibc malloc and once with the library
+ *              (default ./libhmm.so) preloaded, and reports the ops/sec, the peak RSS and the
+ *              fragmentation of both: the peak RSS grown during the workload divided by the
+ *              peak of the bytes the workload had allocated. scale multiplies the operations.
+ * Author: Mohamed Eslam
+ */
+
+#define _GNU_SOURCE // For wait4
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define FLUSH_OPS 64 // Operations a thread counts locally before updating the live bytes
+#define PAGE 4096 // Every page of a block is touched, so its memory counts in the RSS
+#define CHURN_SLOTS 1024 // Live objects of the small-object churn
+#define CHURN_OPS 10000000 // Alloc/free pairs of the small-object churn
+#define RANDOM_SLOTS 8192 // Live blocks of the random-size workload
+#define RANDOM_OPS 2000000 // Alloc or free calls of the random-size workload
+#define REALLOC_BUFS 256 // Buffers growing in turns
+#define REALLOC_MAX (1024*1024) // Size the buffers grow to
+#define REALLOC_ROUNDS 10 // Times the buffers grow from 16 bytes to REALLOC_MAX
+#define PC_PAIRS 4 // Producer/consumer thread pairs
+#define PC_RING 1024 // Blocks in flight between a producer and its consumer
+#define PC_OBJECTS 2000000 // Blocks sent by every producer
+#define LARSON_THREADS 8 // Threads of every larson generation
+#define LARSON_SLOTS 1000 // Live objects per thread
+#define LARSON_OPS 200000 // Replacements done by every thread before handing its objects over
+#define LARSON_GENERATIONS 10 // Thread generations, each one freeing the objects of the previous one
+
+typedef struct workload {
+  const char *name;          // Name given on the command line
+  long (*run)(void);         // Runs the workload, returns the number of malloc/free/realloc calls
+  const char *description;   // Printed in the report
+} workload_t;
+
+typedef struct ring {
+  void *slot[PC_RING];       // Blocks sent by the producer
+  volatile uint32_t head;    // Next slot the producer writes
+  char pad[60];              // Keeps head and tail on their own cache lines
+  volatile uint32_t tail;    // Next slot the consumer reads
+} ring_t;
+
+static long scale = 1; // Multiplies the operations of every workload
+static long liveBytes = 0; // Bytes the workload has allocated, summed over the threads
+static long peakLive = 0; // Peak of liveBytes
+static __thread long livePending = 0; // Change of liveBytes not published by the thread yet
+static __thread uint32_t liveOps = 0; // Operations counted in livePending
+
+static long churnRun(void);
+static long randomRun(void);
+static long reallocRun(void);
+static long prodConsRun(void);
+static long larsonRun(void);
+
+static const workload_t workloads[] = {
+  {"churn", churnRun, "single thread, 16-256 B objects replaced at random"},
+  {"random", randomRun, "single thread, log-uniform sizes 16 B-256 KiB"},
+  {"realloc", reallocRun, "buffers growing by 1.5x in turns up to 1 MiB"},
+  {"prodcons", prodConsRun, "producers allocate, consumers on other threads free"},
+  {"larson", larsonRun, "server threads replacing objects handed over by exited threads"},
+};
+#define WORKLOAD_NUM (sizeof(workloads) / sizeof(workloads[0]))
+
+
+static double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t nextRand(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+/**
+ * @brief Publishes the live bytes counted by the calling thread and updates the peak
+ */
+static void liveFlush(void) {
+    long live = __atomic_add_fetch(&liveBytes, livePending, __ATOMIC_RELAXED);
+    long peak = __atomic_load_n(&peakLive, __ATOMIC_RELAXED);
+
+    while ((live > peak) && !__atomic_compare_exchange_n(&peakLive, &peak, live, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* peak was reloaded by the failed exchange */
+    }
+    livePending = 0;
+    liveOps = 0;
+}
+
+/**
+ * @brief Counts an allocation (positive delta) or a free (negative delta) of the workload
+ */
+static void liveTrack(long delta) {
+    livePending += delta;
+    if (++liveOps >= FLUSH_OPS) {
+        liveFlush();
+    }
+}
+
+/**
+ * @brief Allocates a block, writes its size in its first word and touches all its pages
+ */
+static void *allocBlock(size_t size) {
+    char *ptr = malloc(size);
+
+    if (NULL == ptr) {
+        fprintf(stderr, "malloc(%zu) failed\n", size);
+        exit(1);
+    }
+    for (size_t off = 0; off < size; off += PAGE) {
+        ptr[off] = 1;
+    }
+    *(size_t *)ptr = size;
+    liveTrack((long)size);
+    return ptr;
+}
+
+/**
+ * @brief Frees a block made by allocBlock
+ */
+static void freeBlock(void *ptr) {
+    if (NULL != ptr) {
+        liveTrack(-(long)*(size_t *)ptr);
+        free(ptr);
+    }
+}
+
+static long churnRun(void) {
+    static void *slots[CHURN_SLOTS];
+    uint32_t seed = 1;
+    long ops = CHURN_OPS * scale;
+
+    for (long i = 0; i < ops; i++) {
+        uint32_t r = nextRand(&seed);
+        uint32_t slot = r % CHURN_SLOTS;
+        freeBlock(slots[slot]);
+        slots[slot] = allocBlock(16 + (r >> 16) % 241);
+    }
+    for (int i = 0; i < CHURN_SLOTS; i++) {
+        freeBlock(slots[i]);
+    }
+    return 2 * ops;
+}
+
+static long randomRun(void) {
+    static void *slots[RANDOM_SLOTS];
+    uint32_t seed = 2;
+    long ops = RANDOM_OPS * scale;
+
+    for (long i = 0; i < ops; i++) {
+        uint32_t slot = nextRand(&seed) % RANDOM_SLOTS;
+        if (NULL == slots[slot]) {
+            size_t base = (size_t)16 << (nextRand(&seed) % 14); // 16 B to 128 KiB
+            slots[slot] = allocBlock(base + nextRand(&seed) % base);
+        } else {
+            freeBlock(slots[slot]);
+            slots[slot] = NULL;
+        }
+    }
+    for (int i = 0; i < RANDOM_SLOTS; i++) {
+        freeBlock(slots[i]);
+    }
+    return ops;
+}
+
+static long reallocRun(void) {
+    static char *bufs[REALLOC_BUFS];
+    static size_t sizes[REALLOC_BUFS];
+    long calls = 0;
+
+    for (long round = 0; round < REALLOC_ROUNDS * scale; round++) {
+        for (int i = 0; i < REALLOC_BUFS; i++) {
+            bufs[i] = allocBlock(16);
+            sizes[i] = 16;
+        }
+        for (int grown = 1; grown;) {
+            grown = 0;
+            for (int i = 0; i < REALLOC_BUFS; i++) {
+                if (sizes[i] < REALLOC_MAX) {
+                    size_t newSize = sizes[i] + sizes[i] / 2;
+                    char *newBuf = realloc(bufs[i], newSize);
+                    if (NULL == newBuf) {
+                        fprintf(stderr, "realloc(%zu) failed\n", newSize);
+                        exit(1);
+                    }
+                    for (size_t off = sizes[i]; off < newSize; off += PAGE) {
+                        newBuf[off] = 1;
+                    }
+                    liveTrack((long)(newSize - sizes[i]));
+                    *(size_t *)newBuf = newSize;
+                    bufs[i] = newBuf;
+                    sizes[i] = newSize;
+                    calls++;
+                    grown = 1;
+                }
+            }
+        }
+        for (int i = 0; i < REALLOC_BUFS; i++) {
+            freeBlock(bufs[i]);
+        }
+        calls += 2 * REALLOC_BUFS;
+    }
+    return calls;
+}
+
+static void *producer(void *arg) {
+    ring_t *ring = (ring_t *)arg;
+    uint32_t seed = (uint32_t)(uintptr_t)ring | 1;
+
+    for (long i = 0; i < PC_OBJECTS * scale; i++) {
+        void *block = allocBlock(16 + nextRand(&seed) % 497);
+        while (__atomic_load_n(&ring->head, __ATOMIC_RELAXED) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= PC_RING) {
+            sched_yield(); // Ring full
+        }
+        ring->slot[ring->head % PC_RING] = block;
+        __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    }
+    liveFlush();
+    return NULL;
+}
+
+static void *consumer(void *arg) {
+    ring_t *ring = (ring_t *)arg;
+
+    for (long i = 0; i < PC_OBJECTS * scale; i++) {
+        while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&ring->tail, __ATOMIC_RELAXED)) {
+            sched_yield(); // Ring empty
+        }
+        freeBlock(ring->slot[ring->tail % PC_RING]);
+        __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+    }
+    liveFlush();
+    return NULL;
+}
+
+static long prodConsRun(void) {
+    static ring_t rings[PC_PAIRS];
+    pthread_t tid[2 * PC_PAIRS];
+
+    for (int i = 0; i < PC_PAIRS; i++) {
+        pthread_create(&tid[2 * i], NULL, producer, &rings[i]);
+        pthread_create(&tid[2 * i + 1], NULL, consumer, &rings[i]);
+    }
+    for (int i = 0; i < 2 * PC_PAIRS; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    return 2L * PC_PAIRS * PC_OBJECTS * scale;
+}
+
+static void *larsonWorker(void *arg) {
+    void **slots = (void **)arg;
+    uint32_t seed = (uint32_t)(uintptr_t)slots | 1;
+
+    for (long i = 0; i < LARSON_OPS * scale; i++) {
+        uint32_t slot = nextRand(&seed) % LARSON_SLOTS;
+        freeBlock(slots[slot]); // Most were allocated by a thread that exited
+        slots[slot] = allocBlock(16 + nextRand(&seed) % 1009);
+    }
+    liveFlush();
+    return NULL;
+}
+
+static long larsonRun(void) {
+    static void *slots[LARSON_THREADS][LARSON_SLOTS];
+    pthread_t tid[LARSON_THREADS];
+
+    for (int gen = 0; gen < LARSON_GENERATIONS; gen++) {
+        // Every generation takes over the objects of the previous one
+        for (int i = 0; i < LARSON_THREADS; i++) {
+            pthread_create(&tid[i], NULL, larsonWorker, slots[(i + gen) % LARSON_THREADS]);
+        }
+        for (int i = 0; i < LARSON_THREADS; i++) {
+            pthread_join(tid[i], NULL);
+        }
+    }
+    for (int i = 0; i < LARSON_THREADS; i++) {
+        for (int j = 0; j < LARSON_SLOTS; j++) {
+            freeBlock(slots[i][j]);
+        }
+    }
+    return 2L * LARSON_THREADS * LARSON_GENERATIONS * LARSON_OPS * scale;
+}
+
+/**
+ * @brief Child side: runs one workload and prints its calls, seconds, peak live bytes and startup RSS
+ */
+static int runWorkload(const char *name) {
+    long startRssKb = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (NULL != statm) {
+        long pages = 0;
+        if (1 == fscanf(statm, "%*d %ld", &pages)) {
+            startRssKb = pages * (sysconf(_SC_PAGESIZE) / 1024);
+        }
+        fclose(statm);
+    }
+    for (size_t i = 0; i < WORKLOAD_NUM; i++) {
+        if (0 == strcmp(name, workloads[i].name)) {
+            double start = nowSec();
+            long ops = workloads[i].run();
+            double secs = nowSec() - start;
+            liveFlush();
+            printf("%ld %f %ld %ld\n", ops, secs, peakLive, startRssKb);
+            return 0;
+        }
+    }
+    fprintf(stderr, "unknown workload %s\n", name);
+    return 1;
+}
+
+/**
+ * @brief Parent side: runs a workload in a child, with the library preloaded when lib is not NULL
+ *
+ * @return 0 on success, the ops/sec, peak RSS (KiB) and fragmentation are stored
+ */
+static int spawnWorkload(const char *name, const char *lib, double *opsPerSec, long *peakRssKb, double *frag) {
+    int fds[2];
+    char scaleStr[24];
+    char line[128];
+    int status = 0;
+    struct rusage usage;
+    long ops = 0, peak = 0, startRssKb = 0;
+    double secs = 0;
+    FILE *out = NULL;
+    pid_t pid;
+
+    if (0 != pipe(fds)) {
+        return 1;
+    }
+    snprintf(scaleStr, sizeof(scaleStr), "%ld", scale);
+    pid = fork();
+    if (0 == pid) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        if (NULL == lib) {
+            unsetenv("LD_PRELOAD");
+        } else {
+            setenv("LD_PRELOAD", lib, 1);
+        }
+        execl("/proc/self/exe", "suite", "--run", name, scaleStr, (char *)NULL);
+        _exit(127);
+    }
+    close(fds[1]);
+    out = fdopen(fds[0], "r");
+    if ((NULL == out) || (NULL == fgets(line, sizeof(line), out)) ||
+        (4 != sscanf(line, "%ld %lf %ld %ld", &ops, &secs, &peak, &startRssKb))) {
+        ops = 0;
+    }
+    if (NULL != out) {
+        fclose(out);
+    }
+    if ((pid < 0) || (wait4(pid, &status, 0, &usage) != pid) || !WIFEXITED(status) || (0 != WEXITSTATUS(status)) || (0 == ops)) {
+        return 1;
+    }
+    *opsPerSec = ops / secs;
+    *peakRssKb = usage.ru_maxrss;
+    *frag = (peak > 0) ? (usage.ru_maxrss - startRssKb) * 1024.0 / peak : 0;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char lib[PATH_MAX];
+    int failed = 0;
+
+    if ((argc > 3) && (0 == strcmp(argv[1], "--run"))) {
+        scale = atol(argv[3]);
+        return runWorkload(argv[2]);
+    }
+    if (argc > 2) {
+        scale = atol(argv[2]);
+    }
+    if ((scale < 1) || (NULL == realpath((argc > 1) ? argv[1] : "./libhmm.so", lib))) {
+        printf("%s [library (./libhmm.so)] [scale (1..)]\n", argv[0]);
+        return 1;
+    }
+
+    printf("workload  allocator      ops/sec  peak RSS MiB   frag\n");
+    for (size_t i = 0; i < WORKLOAD_NUM; i++) {
+        double ops[2] = {0}, frag[2] = {0};
+        long rss[2] = {0};
+
+        for (int j = 0; j < 2; j++) {
+            if (0 != spawnWorkload(workloads[i].name, (0 == j) ? NULL : lib, &ops[j], &rss[j], &frag[j])) {
+                printf("%-9s %-9s failed\n", workloads[i].name, (0 == j) ? "glibc" : "hmm");
+                failed = 1;
+            } else {
+                printf("%-9s %-9s %12.0f %13.1f %6.2f\n", workloads[i].name, (0 == j) ? "glibc" : "hmm",
+                       ops[j], rss[j] / 1024.0, frag[j]);
+            }
+        }
+        if ((ops[0] > 0) && (ops[1] > 0)) {
+            printf("%-9s hmm/glibc %11.2fx %12.2fx   (%s)\n", workloads[i].name, ops[1] / ops[0],
+                   (double)rss[1] / rss[0], workloads[i].description);
+        }
+    }
+    return failed;
+}
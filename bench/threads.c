@@ -0,0 +1,71 @@
+/*
+ * File: threads.c
+ * Description: multithreaded small-object alloc/free benchmark, run it with
+ *              LD_PRELOAD=./libhmm.so to measure the allocator scaling.
+ * Author: Mohamed Eslam
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define WINDOW 64 // Number of live objects per thread
+#define DEFAULT_OPS 2000000 // Alloc/free pairs per thread
+#define MAX_THREADS 64
+
+static long opsPerThread = DEFAULT_OPS;
+
+/**
+ * @brief Thread body: keeps WINDOW objects alive and replaces one of them per iteration
+ */
+static void *worker(void *arg) {
+    void *live[WINDOW] = {NULL};
+    uint32_t seed = (uint32_t)(uintptr_t)arg;
+
+    for (long i = 0; i < opsPerThread; i++) {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t slot = (seed >> 16) % WINDOW;
+        free(live[slot]);
+        live[slot] = malloc(16 + ((seed >> 8) % 497)); // 16 to 512 bytes
+        *(volatile char *)live[slot] = 1;
+    }
+    for (int i = 0; i < WINDOW; i++) {
+        free(live[i]);
+    }
+    return NULL;
+}
+
+static double nowSec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int maxThreads = (argc > 1) ? atoi(argv[1]) : 8;
+    pthread_t tid[MAX_THREADS];
+
+    if (argc > 2) {
+        opsPerThread = atol(argv[2]);
+    }
+    if ((maxThreads < 1) || (maxThreads > MAX_THREADS)) {
+        printf("%s [max-threads (1..%d)] [ops-per-thread]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    printf("threads      ops/sec   ops/sec/thread\n");
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        double start = nowSec();
+        for (int i = 0; i < threads; i++) {
+            pthread_create(&tid[i], NULL, worker, (void *)(uintptr_t)(i + 1));
+        }
+        for (int i = 0; i < threads; i++) {
+            pthread_join(tid[i], NULL);
+        }
+        double ops = (double)threads * opsPerThread / (nowSec() - start);
+        printf("%7d %12.0f %16.0f\n", threads, ops, ops / threads);
+    }
+    return 0;
+}
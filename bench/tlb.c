@@ -0,0 +1,88 @@
+/*
+ * File: tlb.c
+ * Description: pointer chase through a large heap in a random order, a TLB miss per hop when the
+ *              heap is backed by small pages. Run it with LD_PRELOAD=./libhmm.so, once with
+ *              HMM_THP=0 and once with HMM_THP=1, and compare ns/hop and the huge page bytes.
+ * Author: Mohamed Eslam
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define HEAP_BYTES (256*1024*1024) // Bytes of blocks allocated by default
+#define BLOCK_MIN 600 // Above the slab sizes, so the blocks come from the arena heap
+#define BLOCK_MAX 2000
+#define HOP_NUM (20*1000*1000) // Timed hops
+
+static void ** volatile lastHop; // Keeps the chase from being optimized out
+
+static double nowNsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Reads a "<key> <n> kB" line of a /proc file
+static long procKb(const char *path, const char *key) {
+    char line[128];
+    long kiloBytes = 0;
+    FILE *file = fopen(path, "r");
+
+    if (NULL != file) {
+        while (NULL != fgets(line, sizeof(line), file)) {
+            if (1 == sscanf(line, key, &kiloBytes)) {
+                break;
+            }
+        }
+        fclose(file);
+    }
+    return kiloBytes;
+}
+
+int main(int argc, char **argv) {
+    size_t heapBytes = (argc > 1) ? (size_t)atol(argv[1]) << 20 : HEAP_BYTES;
+    size_t num = heapBytes / ((BLOCK_MIN + BLOCK_MAX) / 2);
+    void ***blocks = malloc(num * sizeof(void **));
+    size_t *order = malloc(num * sizeof(size_t));
+    unsigned int seed = 1;
+
+    if ((NULL == blocks) || (NULL == order)) {
+        return 1;
+    }
+    for (size_t i = 0; i < num; i++) {
+        blocks[i] = malloc(BLOCK_MIN + rand_r(&seed) % (BLOCK_MAX - BLOCK_MIN));
+        order[i] = i;
+    }
+    // One random cycle through every block (Sattolo), each block points to the next one
+    for (size_t i = num - 1; i > 0; i--) {
+        size_t j = (size_t)rand_r(&seed) % i;
+        size_t tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (size_t i = 0; i < num; i++) {
+        *blocks[order[i]] = blocks[order[(i + 1) % num]];
+    }
+
+    void **hop = blocks[0];
+    double start = nowNsec();
+    for (long i = 0; i < HOP_NUM; i++) {
+        hop = (void **)*hop;
+    }
+    double perHop = (nowNsec() - start) / HOP_NUM;
+    lastHop = hop;
+
+    long rssKb = procKb("/proc/self/status", "VmRSS: %ld kB");
+    long hugeKb = procKb("/proc/self/smaps_rollup", "AnonHugePages: %ld kB");
+    printf("blocks %zu, %zu MiB: %.1f ns/hop, rss %ld MiB, huge pages %ld MiB (%.0f%%)\n",
+           num, heapBytes >> 20, perHop, rssKb >> 10, hugeKb >> 10,
+           (0 != rssKb) ? 100.0 * hugeKb / rssKb : 0.0);
+
+    for (size_t i = 0; i < num; i++) {
+        free(blocks[i]);
+    }
+    free(order);
+    free(blocks);
+    return 0;
+}